@@ -20,6 +20,32 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* Threads blocked in timer_sleep(), in order of increasing
+   wakeup_tick, and the earliest wakeup_tick among them (or
+   INT64_MAX if there are none).  Caching the earliest deadline
+   lets timer_interrupt() skip the list on most ticks. */
+static struct list sleep_list;
+static int64_t next_wakeup;
+
+/* If true, the idle thread stops the periodic tick while it
+   waits for the next deadline.  Controlled by kernel command-line
+   option "-tickless". */
+bool timer_tickless;
+
+/* PIT cycles per timer tick. */
+#define PIT_TICK_COUNT ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Longest interval a single one-shot PIT count can cover, in
+   timer ticks. */
+#define ONESHOT_MAX_TICKS (0xffff / PIT_TICK_COUNT)
+
+/* Number of ticks the pending one-shot PIT count covers, or 0 if
+   the PIT is in periodic mode. */
+static int64_t oneshot_ticks;
+
+/* Number of ticks accounted for without a periodic interrupt. */
+static int64_t skipped_ticks;
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
@@ -29,12 +55,18 @@ static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static bool wakeup_less (const struct list_elem *, const struct list_elem *,
+                         void *aux);
+static void wake_sleepers (void);
+static void timer_advance (bool user);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void
 timer_init (void) 
 {
+  list_init (&sleep_list);
+  next_wakeup = INT64_MAX;
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
@@ -85,15 +117,28 @@ timer_elapsed (int64_t then)
 }
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.
+
+   The thread blocks on sleep_list until timer_interrupt() wakes
+   it, so sleeping threads take no CPU time in the meantime. */
 void
 timer_sleep (int64_t ticks) 
 {
   int64_t start = timer_ticks ();
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks) 
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable ();
+  cur->wakeup_tick = start + ticks;
+  list_insert_ordered (&sleep_list, &cur->elem, wakeup_less, NULL);
+  if (cur->wakeup_tick < next_wakeup)
+    next_wakeup = cur->wakeup_tick;
+  thread_block ();
+  intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -164,14 +209,145 @@ void
 timer_print_stats (void) 
 {
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  if (timer_tickless)
+    printf ("Timer: %"PRId64" ticks skipped while idle\n", skipped_ticks);
 }
-
+
+/* Called by the idle thread, with interrupts off, just before it
+   halts the CPU.  In tickless mode, if no thread needs to wake up
+   for at least two ticks, replaces the periodic tick by a single
+   PIT interrupt at the next deadline (or as far ahead as one PIT
+   count reaches), so the CPU stays halted in the meantime.  The
+   one-shot count ends on a boundary of the periodic tick it
+   replaces, so the tick phase is preserved. */
+void
+timer_idle_enter (void)
+{
+  int64_t idle_ticks;
+  unsigned count;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || oneshot_ticks != 0)
+    return;
+
+  idle_ticks = next_wakeup - ticks;
+  if (idle_ticks > ONESHOT_MAX_TICKS)
+    idle_ticks = ONESHOT_MAX_TICKS;
+  if (idle_ticks < 2 || intr_ext_pending (0x20))
+    return;
+
+  /* Count out the rest of the current tick, then IDLE_TICKS - 1
+     more whole ticks. */
+  count = pit_read_count (0) + (idle_ticks - 1) * PIT_TICK_COUNT;
+  if (count > 0xffff)
+    {
+      count -= PIT_TICK_COUNT;
+      idle_ticks--;
+    }
+  pit_start_oneshot (0, count);
+  oneshot_ticks = idle_ticks;
+}
+
+/* Called by the scheduler, with interrupts off, whenever the
+   idle thread gives up the CPU, whether it blocks again or an
+   interrupt handler woke a thread and preempted it.  If an
+   interrupt other than the timer's ended the halt before the
+   one-shot count expired, accounts for the whole ticks that have
+   elapsed and counts out just the rest of the current tick, so
+   that periodic ticks resume from the next tick boundary while
+   threads are runnable. */
+void
+timer_idle_exit (void)
+{
+  unsigned remaining, ticks_left;
+  int64_t elapsed;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* If the count has already expired, the pending timer
+     interrupt will do the accounting. */
+  if (oneshot_ticks == 0 || pit_output_high (0))
+    return;
+  remaining = pit_read_count (0);
+  if (remaining == 0)
+    return;
+
+  ticks_left = DIV_ROUND_UP (remaining, PIT_TICK_COUNT);
+  elapsed = oneshot_ticks - ticks_left;
+  pit_start_oneshot (0, remaining - (ticks_left - 1) * PIT_TICK_COUNT);
+  oneshot_ticks = 1;
+  skipped_ticks += elapsed;
+  while (elapsed-- > 0)
+    timer_advance (false);
+}
+
 /* Timer interrupt handler. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+timer_interrupt (struct intr_frame *args)
+{
+  /* The low 2 bits of the code segment selector hold the
+     privilege level that was interrupted: 3 for user mode. */
+  bool user = (args->cs & 3) == 3;
+  int64_t elapsed = 1;
+
+  /* A one-shot count covering several ticks just expired.
+     Account for all of them and go back to periodic mode. */
+  if (oneshot_ticks != 0)
+    {
+      elapsed = oneshot_ticks;
+      skipped_ticks += elapsed - 1;
+      oneshot_ticks = 0;
+      pit_configure_channel (0, 2, TIMER_FREQ);
+    }
+  while (elapsed-- > 0)
+    timer_advance (user);
+}
+
+/* Advances the clock by one tick, waking up any sleeping threads
+   whose time has come.  USER is true if the tick interrupted
+   user mode. */
+static void
+timer_advance (bool user)
 {
   ticks++;
-  thread_tick ();
+  if (ticks >= next_wakeup)
+    wake_sleepers ();
+  thread_tick (user);
+}
+
+/* Returns true if the thread that owns sleep_list element A
+   should wake before the one that owns B. */
+static bool
+wakeup_less (const struct list_elem *a, const struct list_elem *b,
+             void *aux UNUSED)
+{
+  return (list_entry (a, struct thread, elem)->wakeup_tick
+          < list_entry (b, struct thread, elem)->wakeup_tick);
+}
+
+/* Unblocks every sleeping thread whose wakeup time has arrived
+   and recomputes next_wakeup.  Called from the timer interrupt
+   handler. */
+static void
+wake_sleepers (void)
+{
+  while (!list_empty (&sleep_list))
+    {
+      struct thread *t = list_entry (list_front (&sleep_list),
+                                     struct thread, elem);
+      if (t->wakeup_tick > ticks)
+        break;
+      list_pop_front (&sleep_list);
+      thread_unblock (t);
+    }
+
+  if (list_empty (&sleep_list))
+    next_wakeup = INT64_MAX;
+  else
+    next_wakeup = list_entry (list_front (&sleep_list),
+                              struct thread, elem)->wakeup_tick;
+  thread_preempt ();
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
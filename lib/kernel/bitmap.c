@@ -69,6 +69,69 @@ last_mask (const struct bitmap *b)
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns a mask with the CNT bits starting at bit OFS of an
+   element set to 1 and the rest set to 0.  OFS + CNT must not
+   exceed ELEM_BITS, and CNT must be nonzero. */
+static inline elem_type
+range_mask (size_t ofs, size_t cnt)
+{
+  elem_type mask = (cnt < ELEM_BITS
+                    ? ((elem_type) 1 << cnt) - 1 : (elem_type) -1);
+  return mask << ofs;
+}
+
+/* Returns the index of the least significant 1-bit in X, which
+   must be nonzero.  See [IA32-v2a] "BSF". */
+static inline size_t
+bit_scan_forward (elem_type x)
+{
+  elem_type idx;
+  asm ("bsfl %1, %0" : "=r" (idx) : "rm" (x) : "cc");
+  return idx;
+}
+
+/* Returns the number of 1-bits in X, by adding up adjacent
+   groups of bits in parallel.  Assumes a 32-bit elem_type. */
+static inline size_t
+popcount (elem_type x)
+{
+  x = x - ((x >> 1) & 0x55555555);
+  x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+  x = (x + (x >> 4)) & 0x0f0f0f0f;
+  return (x * 0x01010101) >> 24;
+}
+
+/* Returns the element of B's bits that contains bit BIT_IDX,
+   inverted if VALUE is false, so that the bits set to VALUE in
+   B are 1-bits in the result. */
+static inline elem_type
+elem_as (const struct bitmap *b, size_t bit_idx, bool value)
+{
+  elem_type e = b->bits[elem_idx (bit_idx)];
+  return value ? e : ~e;
+}
+
+/* Returns the index of the first bit in B between START and END,
+   exclusive, that is set to VALUE, or END if there is none.
+   Whole elements in which no bit is set to VALUE are skipped in
+   one step each. */
+static size_t
+find_next (const struct bitmap *b, size_t start, size_t end, bool value)
+{
+  while (start < end)
+    {
+      size_t ofs = start % ELEM_BITS;
+      elem_type e = elem_as (b, start, value) & ((elem_type) -1 << ofs);
+      if (e != 0)
+        {
+          size_t idx = start - ofs + bit_scan_forward (e);
+          return idx < end ? idx : end;
+        }
+      start += ELEM_BITS - ofs;
+    }
+  return end;
+}
+
 /* Creation and destruction. */
 
 /* Initializes B to be a bitmap of BIT_CNT bits
@@ -214,18 +277,31 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Each element is updated atomically, as by bitmap_mark() and
+   bitmap_reset(), but the group as a whole is not. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
+  size_t end = start + cnt;
+
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  while (start < end)
+    {
+      size_t ofs = start % ELEM_BITS;
+      size_t n = end - start < ELEM_BITS - ofs ? end - start : ELEM_BITS - ofs;
+      elem_type mask = range_mask (ofs, n);
+      elem_type *e = &b->bits[elem_idx (start)];
+
+      if (value)
+        asm ("orl %1, %0" : "=m" (*e) : "r" (mask) : "cc");
+      else
+        asm ("andl %1, %0" : "=m" (*e) : "r" (~mask) : "cc");
+      start += n;
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -233,16 +309,22 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t value_cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
   value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
+  while (start < end)
+    {
+      size_t ofs = start % ELEM_BITS;
+      size_t n = end - start < ELEM_BITS - ofs ? end - start : ELEM_BITS - ofs;
+
+      value_cnt += popcount (elem_as (b, start, value) & range_mask (ofs, n));
+      start += n;
+    }
   return value_cnt;
 }
 
@@ -251,16 +333,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return find_next (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -299,13 +376,29 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
+  if (cnt == 0)
+    return start;
   if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = start;
+
+      /* Find the next bit set to VALUE, then the next bit after
+         it that isn't.  If the run between them is long enough,
+         we're done; otherwise, resume the search after the
+         run. */
+      while (i <= last)
+        {
+          size_t run_end;
+
+          i = find_next (b, i, last + 1, value);
+          if (i > last)
+            break;
+          run_end = find_next (b, i, i + cnt, !value);
+          if (run_end == i + cnt)
+            return i;
+          i = run_end;
+        }
     }
   return BITMAP_ERROR;
 }
@@ -0,0 +1,221 @@
+/* Test program and microbenchmark for lib/kernel/bitmap.c.
+
+   Checks the word-at-a-time bitmap operations against simple
+   bit-at-a-time versions built on bitmap_test() and
+   bitmap_set(), like the ones they replaced, on random bitmaps
+   of various sizes and densities.  Then times both versions of
+   each operation on a bitmap the size of a large user pool.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/cpu.h"
+#include "threads/test.h"
+
+/* Maximum number of bits in a bitmap that we will test. */
+#define MAX_BITS 300
+
+/* Number of bits in the bitmap used for timing: one per page in
+   a 256 MB pool. */
+#define BENCH_BITS 65536
+
+/* Number of times each timed operation is repeated. */
+#define BENCH_REPEAT 16
+
+static void randomize (struct bitmap *, int density);
+static size_t slow_count (const struct bitmap *, size_t start, size_t cnt,
+                          bool value);
+static bool slow_contains (const struct bitmap *, size_t start, size_t cnt,
+                           bool value);
+static size_t slow_scan (const struct bitmap *, size_t start, size_t cnt,
+                         bool value);
+static void slow_set_multiple (struct bitmap *, size_t start, size_t cnt,
+                               bool value);
+static void verify (void);
+static void benchmark (void);
+
+/* Test the bitmap implementation. */
+void
+test (void)
+{
+  verify ();
+  benchmark ();
+  printf ("bitmap: PASS\n");
+}
+
+/* Compares the bitmap operations against their bit-at-a-time
+   equivalents on many random bitmaps and ranges. */
+static void
+verify (void)
+{
+  size_t size;
+
+  printf ("testing various size bitmaps:");
+  for (size = 0; size <= MAX_BITS; size += size < 70 ? 1 : 23)
+    {
+      struct bitmap *a = bitmap_create (size);
+      struct bitmap *b = bitmap_create (size);
+      int repeat;
+
+      ASSERT (a != NULL && b != NULL);
+      printf (" %zu", size);
+      for (repeat = 0; repeat < 20; repeat++)
+        {
+          int density = repeat % 5 * 25;
+          size_t start = random_ulong () % (size + 1);
+          size_t cnt = random_ulong () % (size - start + 1);
+          bool value = random_ulong () % 2;
+          size_t i;
+
+          randomize (a, density);
+          for (i = 0; i < size; i++)
+            bitmap_set (b, i, bitmap_test (a, i));
+
+          ASSERT (bitmap_count (a, start, cnt, value)
+                  == slow_count (a, start, cnt, value));
+          ASSERT (bitmap_contains (a, start, cnt, value)
+                  == slow_contains (a, start, cnt, value));
+          ASSERT (bitmap_scan (a, start, cnt % 40, value)
+                  == slow_scan (a, start, cnt % 40, value));
+
+          bitmap_set_multiple (a, start, cnt, value);
+          slow_set_multiple (b, start, cnt, value);
+          for (i = 0; i < size; i++)
+            ASSERT (bitmap_test (a, i) == bitmap_test (b, i));
+        }
+
+      bitmap_destroy (a);
+      bitmap_destroy (b);
+    }
+  printf (" done\n");
+}
+
+/* Times each operation and its bit-at-a-time equivalent on a
+   large bitmap, printing the average cost of each in CPU
+   cycles. */
+static void
+benchmark (void)
+{
+  struct bitmap *b = bitmap_create (BENCH_BITS);
+  uint64_t fast, slow, start;
+  size_t fast_result, slow_result;
+  int i;
+
+  ASSERT (b != NULL);
+
+  /* A mostly full pool: the only free run long enough for the
+     scans sits near the end. */
+  randomize (b, 95);
+  bitmap_set_multiple (b, BENCH_BITS - 100, 16, false);
+
+#define TIME(VAR, RESULT, EXPR)                         \
+  do                                                    \
+    {                                                   \
+      start = cpu_read_tsc ();                          \
+      for (i = 0; i < BENCH_REPEAT; i++)                \
+        RESULT = EXPR;                                  \
+      VAR = (cpu_read_tsc () - start) / BENCH_REPEAT;   \
+    }                                                   \
+  while (0)
+
+  TIME (fast, fast_result, bitmap_scan (b, 0, 16, false));
+  TIME (slow, slow_result, slow_scan (b, 0, 16, false));
+  ASSERT (fast_result == slow_result);
+  printf ("bitmap_scan: %llu cycles, bit-at-a-time: %llu cycles\n",
+          fast, slow);
+
+  TIME (fast, fast_result, bitmap_count (b, 0, BENCH_BITS, true));
+  TIME (slow, slow_result, slow_count (b, 0, BENCH_BITS, true));
+  ASSERT (fast_result == slow_result);
+  printf ("bitmap_count: %llu cycles, bit-at-a-time: %llu cycles\n",
+          fast, slow);
+
+  /* A completely full pool, so that every bit must be
+     examined. */
+  bitmap_set_all (b, true);
+  TIME (fast, fast_result, bitmap_contains (b, 0, BENCH_BITS, false));
+  TIME (slow, slow_result, slow_contains (b, 0, BENCH_BITS, false));
+  ASSERT (fast_result == slow_result);
+  printf ("bitmap_contains: %llu cycles, bit-at-a-time: %llu cycles\n",
+          fast, slow);
+
+  start = cpu_read_tsc ();
+  for (i = 0; i < BENCH_REPEAT; i++)
+    bitmap_set_multiple (b, 3, BENCH_BITS - 6, i % 2);
+  fast = (cpu_read_tsc () - start) / BENCH_REPEAT;
+  start = cpu_read_tsc ();
+  for (i = 0; i < BENCH_REPEAT; i++)
+    slow_set_multiple (b, 3, BENCH_BITS - 6, i % 2);
+  slow = (cpu_read_tsc () - start) / BENCH_REPEAT;
+  printf ("bitmap_set_multiple: %llu cycles, bit-at-a-time: %llu cycles\n",
+          fast, slow);
+
+#undef TIME
+  bitmap_destroy (b);
+}
+
+/* Sets each bit in B to true with probability DENSITY percent. */
+static void
+randomize (struct bitmap *b, int density)
+{
+  size_t i;
+
+  for (i = 0; i < bitmap_size (b); i++)
+    bitmap_set (b, i, (int) (random_ulong () % 100) < density);
+}
+
+/* Bit-at-a-time version of bitmap_count(). */
+static size_t
+slow_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i, value_cnt = 0;
+
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (b, start + i) == value)
+      value_cnt++;
+  return value_cnt;
+}
+
+/* Bit-at-a-time version of bitmap_contains(). */
+static bool
+slow_contains (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (b, start + i) == value)
+      return true;
+  return false;
+}
+
+/* Bit-at-a-time version of bitmap_scan(). */
+static size_t
+slow_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  if (cnt <= bitmap_size (b))
+    {
+      size_t last = bitmap_size (b) - cnt;
+      size_t i;
+
+      for (i = start; i <= last; i++)
+        if (!slow_contains (b, i, cnt, !value))
+          return i;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Bit-at-a-time version of bitmap_set_multiple(). */
+static void
+slow_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    bitmap_set (b, start + i, value);
+}
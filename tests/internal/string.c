@@ -0,0 +1,227 @@
+/* Test program and microbenchmark for the memory and string
+   functions in lib/string.c.
+
+   Checks memcpy(), memmove(), memset(), memcmp(), memchr() and
+   strlen() against simple byte-at-a-time versions, like the ones
+   they replaced, for all small sizes and alignments.  Then times
+   both versions of each function on blocks of several sizes and
+   prints their throughput in bytes per cycle.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/cpu.h"
+#include "threads/test.h"
+
+/* Largest block used for checking, and largest benchmarked. */
+#define CHECK_SIZE 80
+#define BENCH_SIZE 4096
+
+/* Number of times each timed call is repeated. */
+#define BENCH_REPEAT 64
+
+static unsigned char src[BENCH_SIZE + 8], dst[BENCH_SIZE + 8];
+static unsigned char ref[BENCH_SIZE + 8];
+
+/* Receives the result of each timed call, so that the compiler
+   cannot discard calls to pure functions. */
+static volatile uintptr_t sink;
+
+static void check (void);
+static void benchmark (void);
+static void print_rate (const char *name, size_t size,
+                        uint64_t fast, uint64_t slow);
+static void *slow_memcpy (void *, const void *, size_t);
+static void *slow_memset (void *, int, size_t);
+static size_t slow_strlen (const char *);
+static void *slow_memchr (const void *, int, size_t);
+
+/* Test the memory and string functions. */
+void
+test (void)
+{
+  check ();
+  benchmark ();
+  printf ("string: PASS\n");
+}
+
+/* Compares each function against a byte-at-a-time version for
+   every size up to CHECK_SIZE at every alignment. */
+static void
+check (void)
+{
+  size_t size, s_ofs, d_ofs, i;
+
+  printf ("testing memory and string functions:");
+  for (size = 0; size <= CHECK_SIZE; size++)
+    {
+      if (size % 10 == 0)
+        printf (" %zu", size);
+      for (s_ofs = 0; s_ofs < 4; s_ofs++)
+        for (d_ofs = 0; d_ofs < 4; d_ofs++)
+          {
+            unsigned char ch;
+
+            for (i = 0; i < sizeof src; i++)
+              src[i] = random_ulong () % 254 + 1;
+
+            /* memcpy() and memset(). */
+            memset (dst, 0, sizeof dst);
+            memset (ref, 0, sizeof ref);
+            ASSERT (memcpy (dst + d_ofs, src + s_ofs, size) == dst + d_ofs);
+            slow_memcpy (ref + d_ofs, src + s_ofs, size);
+            ASSERT (!memcmp (dst, ref, sizeof dst));
+            ASSERT (memset (dst + d_ofs, s_ofs, size) == dst + d_ofs);
+            slow_memset (ref + d_ofs, s_ofs, size);
+            ASSERT (!memcmp (dst, ref, sizeof dst));
+
+            /* memmove() with overlap in both directions. */
+            slow_memcpy (dst, src, sizeof dst);
+            slow_memcpy (ref, src, sizeof ref);
+            ASSERT (memmove (dst + d_ofs, dst + s_ofs, size) == dst + d_ofs);
+            for (i = 0; i < size; i++)
+              ASSERT (dst[d_ofs + i] == ref[s_ofs + i]);
+
+            /* memcmp() finds a single differing byte. */
+            slow_memcpy (dst, src, sizeof dst);
+            ASSERT (memcmp (dst + d_ofs, src + d_ofs, size) == 0);
+            if (size > 0)
+              {
+                i = d_ofs + random_ulong () % size;
+                dst[i]++;
+                ASSERT (memcmp (dst + d_ofs, src + d_ofs, size) > 0);
+                ASSERT (memcmp (src + d_ofs, dst + d_ofs, size) < 0);
+              }
+
+            /* memchr() and strlen(). */
+            ch = size > 0 ? src[s_ofs + random_ulong () % size] : 1;
+            for (i = 0; i < size; i++)
+              if (src[s_ofs + i] == ch)
+                break;
+            ASSERT (memchr (src + s_ofs, ch, size)
+                    == (i < size ? src + s_ofs + i : NULL));
+            src[s_ofs + size] = '\0';
+            ASSERT (strlen ((char *) src + s_ofs)
+                    == slow_strlen ((char *) src + s_ofs));
+          }
+    }
+  printf (" done\n");
+}
+
+/* Times each function on blocks of several sizes. */
+static void
+benchmark (void)
+{
+  static const size_t sizes[] = {16, 64, 256, 1024, BENCH_SIZE};
+  size_t i;
+
+  memset (src, 'x', sizeof src);
+  src[BENCH_SIZE] = '\0';
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    {
+      size_t size = sizes[i];
+      uint64_t fast, slow, start;
+      int j;
+
+#define TIME(VAR, EXPR)                                         \
+      do                                                        \
+        {                                                       \
+          start = cpu_read_tsc ();                              \
+          for (j = 0; j < BENCH_REPEAT; j++)                    \
+            sink = (uintptr_t) (EXPR);                          \
+          VAR = (cpu_read_tsc () - start) / BENCH_REPEAT;       \
+        }                                                       \
+      while (0)
+
+      TIME (fast, memcpy (dst, src, size));
+      TIME (slow, slow_memcpy (dst, src, size));
+      print_rate ("memcpy", size, fast, slow);
+
+      TIME (fast, memmove (dst + 4, dst, size));
+      TIME (slow, slow_memcpy (dst, src, size));
+      print_rate ("memmove", size, fast, slow);
+
+      TIME (fast, memset (dst, 0, size));
+      TIME (slow, slow_memset (dst, 0, size));
+      print_rate ("memset", size, fast, slow);
+
+      src[size] = '\0';
+      TIME (fast, strlen ((char *) src));
+      TIME (slow, slow_strlen ((char *) src));
+      print_rate ("strlen", size, fast, slow);
+      src[size] = 'x';
+
+      TIME (fast, memchr (src, 'y', size));
+      TIME (slow, slow_memchr (src, 'y', size));
+      print_rate ("memchr", size, fast, slow);
+#undef TIME
+    }
+}
+
+/* Prints the throughput of a SIZE-byte call to NAME that took
+   FAST cycles, and that of its byte-at-a-time version that took
+   SLOW cycles, in bytes per cycle with two decimal places. */
+static void
+print_rate (const char *name, size_t size, uint64_t fast, uint64_t slow)
+{
+  unsigned long long fast_rate = fast ? size * 100ULL / fast : 0;
+  unsigned long long slow_rate = slow ? size * 100ULL / slow : 0;
+
+  printf ("%s %zu bytes: %llu.%02llu bytes/cycle, "
+          "byte-at-a-time %llu.%02llu bytes/cycle\n", name, size,
+          fast_rate / 100, fast_rate % 100,
+          slow_rate / 100, slow_rate % 100);
+}
+
+/* Byte-at-a-time memcpy(). */
+static void *
+slow_memcpy (void *dst_, const void *src_, size_t size)
+{
+  volatile unsigned char *dst = dst_;
+  const unsigned char *src = src_;
+
+  while (size-- > 0)
+    *dst++ = *src++;
+  return dst_;
+}
+
+/* Byte-at-a-time memset(). */
+static void *
+slow_memset (void *dst_, int value, size_t size)
+{
+  volatile unsigned char *dst = dst_;
+
+  while (size-- > 0)
+    *dst++ = value;
+  return dst_;
+}
+
+/* Byte-at-a-time strlen(). */
+static size_t
+slow_strlen (const char *string)
+{
+  const volatile char *p;
+
+  for (p = string; *p != '\0'; p++)
+    continue;
+  return p - string;
+}
+
+/* Byte-at-a-time memchr(). */
+static void *
+slow_memchr (const void *block_, int ch_, size_t size)
+{
+  const volatile unsigned char *block = block_;
+  unsigned char ch = ch_;
+
+  for (; size-- > 0; block++)
+    if (*block == ch)
+      return (void *) block;
+  return NULL;
+}
@@ -0,0 +1,127 @@
+/* Microbenchmark for context switches and the TLB refills that
+   follow them.
+
+   Two threads hand control back and forth with a pair of
+   semaphores, and after each switch the thread that wakes up
+   reads one word from each of several 4 MB pages of the kernel's
+   mapping of physical memory.  We print the cost of a round trip
+   (two switches) in cycles, first with kernel mappings global,
+   as paging_init() sets them up when the CPU supports it, then
+   with CR4.PGE cleared so that every CR3 reload also flushes the
+   kernel's translations.
+
+   Switches reload CR3 only in kernels built with USERPROG, in
+   which process_activate() runs on every switch, so that is where
+   the two rows differ.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/cpu.h"
+#include "threads/loader.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/test.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Number of round trips timed for each measurement. */
+#define ROUNDS 1000
+
+/* Numbers of 4 MB pages read after each switch. */
+static const size_t touch_counts[] = {0, 4, 16, 64};
+#define TOUCH_COUNT_CNT (sizeof touch_counts / sizeof *touch_counts)
+
+static struct semaphore ping, pong;
+static size_t touch_cnt;
+static volatile uint32_t sink;
+
+static uint64_t time_round_trip (size_t cnt);
+static void partner (void *aux);
+static void touch (void);
+
+void
+test (void)
+{
+  uint32_t cr4 = cpu_read_cr4 ();
+  bool pge = (cr4 & CR4_PGE) != 0;
+  size_t i;
+
+  printf ("context switch round trip, in cycles, with global kernel "
+          "pages %s:\n", pge ? "on and off" : "unsupported");
+  for (i = 0; i < TOUCH_COUNT_CNT; i++)
+    {
+      size_t cnt = touch_counts[i];
+      uint64_t global = time_round_trip (cnt);
+
+      if (pge)
+        {
+          uint64_t flushed;
+
+          cpu_write_cr4 (cr4 & ~CR4_PGE);
+          flushed = time_round_trip (cnt);
+          cpu_write_cr4 (cr4);
+          printf ("%2zu pages touched: %6llu global, %6llu flushed\n",
+                  cnt, global, flushed);
+        }
+      else
+        printf ("%2zu pages touched: %6llu\n", cnt, global);
+    }
+
+  printf ("switch: PASS\n");
+}
+
+/* Returns the average number of cycles for a round trip between
+   this thread and a partner thread, each of which reads one word
+   from each of CNT 4 MB pages after it wakes up. */
+static uint64_t
+time_round_trip (size_t cnt)
+{
+  uint64_t start;
+  int i;
+
+  touch_cnt = cnt;
+  sema_init (&ping, 0);
+  sema_init (&pong, 0);
+  thread_create ("partner", PRI_DEFAULT, partner, NULL);
+
+  start = cpu_read_tsc ();
+  for (i = 0; i < ROUNDS; i++)
+    {
+      sema_up (&ping);
+      sema_down (&pong);
+      touch ();
+    }
+  return (cpu_read_tsc () - start) / ROUNDS;
+}
+
+/* Partner thread for time_round_trip(). */
+static void
+partner (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i < ROUNDS; i++)
+    {
+      sema_down (&ping);
+      touch ();
+      sema_up (&pong);
+    }
+}
+
+/* Reads one word from each of the first TOUCH_CNT 4 MB pages of
+   physical memory, or from as many as there are. */
+static void
+touch (void)
+{
+  size_t ram_pages = init_ram_pages / (PTSPAN / PGSIZE);
+  size_t i;
+
+  for (i = 0; i < touch_cnt && i < ram_pages; i++)
+    sink += *(volatile uint32_t *) ptov (i * PTSPAN + PTSPAN / 2);
+}
@@ -0,0 +1,46 @@
+/* Forks a child, which checks that it sees the data its parent
+   wrote before the fork and then overwrites the data.  The
+   parent checks that its own copy did not change: the two
+   processes share their pages only until one writes to them. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 1024)
+
+static char buf[SIZE];
+
+static bool
+buf_intact (void)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (char) (i % 251))
+      return false;
+  return true;
+}
+
+void
+test_main (void)
+{
+  pid_t child;
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i % 251;
+
+  child = fork ();
+  if (child == 0)
+    {
+      CHECK (buf_intact (), "child sees parent's data");
+      memset (buf, 0x5a, SIZE);
+      exit (81);
+    }
+  if (child == PID_ERROR)
+    fail ("fork failed");
+  CHECK (wait (child) == 81, "wait for child");
+  CHECK (buf_intact (), "parent's data unchanged");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fork-cow) begin
+(fork-cow) child sees parent's data
+fork-cow: exit(81)
+(fork-cow) wait for child
+(fork-cow) parent's data unchanged
+(fork-cow) end
+fork-cow: exit(0)
+EOF
+pass;
@@ -0,0 +1,53 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Feature flags returned in EDX by CPUID with EAX = 1.
+   See [IA32-v2a] "CPUID". */
+#define CPUID_PSE 0x00000008    /* Page Size Extensions (4 MB pages). */
+#define CPUID_PGE 0x00002000    /* Page Global Enable. */
+
+/* Flags in control register 4. */
+#define CR4_PSE 0x00000010      /* Page Size Extensions (4 MB pages). */
+#define CR4_PGE 0x00000080      /* Page Global Enable. */
+
+/* Returns the processor's feature flags, as reported by CPUID
+   in EDX. */
+static inline uint32_t
+cpu_features (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return edx;
+}
+
+/* Returns the contents of control register 4. */
+static inline uint32_t
+cpu_read_cr4 (void)
+{
+  uint32_t cr4;
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  return cr4;
+}
+
+/* Stores CR4 into control register 4.  Changing CR4_PGE or
+   CR4_PSE flushes the entire TLB, global entries included. */
+static inline void
+cpu_write_cr4 (uint32_t cr4)
+{
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4) : "memory");
+}
+
+/* Returns the processor's time-stamp counter, which counts CPU
+   cycles since reset.  See [IA32-v2b] "RDTSC". */
+static inline uint64_t
+cpu_read_tsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+#endif /* threads/cpu.h */
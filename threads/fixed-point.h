@@ -0,0 +1,88 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* Signed 17.14 fixed-point arithmetic, used by the multi-level
+   feedback queue scheduler for load_avg and recent_cpu.
+
+   A fixed_t holds a real number X as the integer X * 2**14, so
+   it has 17 bits before the binary point (including the sign)
+   and 14 bits after.  Products and quotients of two fixed_t
+   values are computed in 64 bits to avoid overflow. */
+typedef int fixed_t;
+
+#define FP_SHIFT 14                     /* Number of fraction bits. */
+#define FP_ONE (1 << FP_SHIFT)          /* 1.0 as a fixed_t. */
+
+/* Converts integer N to fixed point. */
+static inline fixed_t
+fp_from_int (int n)
+{
+  return n * FP_ONE;
+}
+
+/* Converts X to an integer, rounding toward zero. */
+static inline int
+fp_trunc (fixed_t x)
+{
+  return x / FP_ONE;
+}
+
+/* Converts X to an integer, rounding to nearest. */
+static inline int
+fp_round (fixed_t x)
+{
+  return x >= 0 ? (x + FP_ONE / 2) / FP_ONE : (x - FP_ONE / 2) / FP_ONE;
+}
+
+/* Returns X + Y. */
+static inline fixed_t
+fp_add (fixed_t x, fixed_t y)
+{
+  return x + y;
+}
+
+/* Returns X + N, where N is an integer. */
+static inline fixed_t
+fp_add_int (fixed_t x, int n)
+{
+  return x + n * FP_ONE;
+}
+
+/* Returns X - Y. */
+static inline fixed_t
+fp_sub (fixed_t x, fixed_t y)
+{
+  return x - y;
+}
+
+/* Returns X * Y. */
+static inline fixed_t
+fp_mul (fixed_t x, fixed_t y)
+{
+  return ((int64_t) x) * y / FP_ONE;
+}
+
+/* Returns X * N, where N is an integer. */
+static inline fixed_t
+fp_mul_int (fixed_t x, int n)
+{
+  return x * n;
+}
+
+/* Returns X / Y. */
+static inline fixed_t
+fp_div (fixed_t x, fixed_t y)
+{
+  return ((int64_t) x) * FP_ONE / y;
+}
+
+/* Returns X / N, where N is an integer. */
+static inline fixed_t
+fp_div_int (fixed_t x, int n)
+{
+  return x / n;
+}
+
+#endif /* threads/fixed-point.h */
@@ -1,5 +1,6 @@
 #include "threads/init.h"
 #include <console.h>
+#include <ctype.h>
 #include <debug.h>
 #include <inttypes.h>
 #include <limits.h>
@@ -15,13 +16,16 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
+#include "threads/vmalloc.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -37,6 +41,11 @@
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
@@ -58,10 +67,12 @@ static const char *swap_bdev_name;
 static size_t user_page_limit = SIZE_MAX;
 
 static void bss_init (void);
+static void ram_init (void);
 static void paging_init (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
+static size_t parse_count (const char *name, const char *value);
 static void run_actions (char **argv);
 static void usage (void);
 
@@ -78,8 +89,9 @@ main (void)
 {
   char **argv;
 
-  /* Clear BSS. */  
+  /* Clear BSS and find out how much RAM we have. */  
   bss_init ();
+  ram_init ();
 
   /* Break command line into arguments and parse options. */
   argv = read_command_line ();
@@ -98,6 +110,7 @@ main (void)
   palloc_init (user_page_limit);
   malloc_init ();
   paging_init ();
+  vmalloc_init ();
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -114,6 +127,10 @@ main (void)
   exception_init ();
   syscall_init ();
 #endif
+#ifdef VM
+  page_init ();
+  frame_init ();
+#endif
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
@@ -126,6 +143,9 @@ main (void)
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
+#ifdef VM
+  swap_init ();
+#endif
 
   printf ("Boot complete.\n");
   
@@ -150,34 +170,93 @@ bss_init (void)
   memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
-/* Populates the base page directory and page table with the
-   kernel virtual mapping, and then sets up the CPU to use the
-   new page directory.  Points init_page_dir to the page
-   directory it creates. */
+/* Sets init_ram_pages from the BIOS memory map, if start.S
+   obtained one.  We use the RAM that runs without a break from
+   1 MB, where palloc_init() puts its pools, up to LOADER_RAM_MAX,
+   which is as much as the kernel can map.  Without a map, the
+   memory size that start.S obtained the old way, at most 64 MB,
+   stands. */
+static void
+ram_init (void) 
+{
+  uint64_t end = 1024 * 1024;
+  bool grew;
+  uint32_t i;
+
+  /* Regions may come in any order, so keep extending END by any
+     region of RAM that contains it until none does. */
+  do
+    {
+      grew = false;
+      for (i = 0; i < e820_cnt; i++) 
+        {
+          const struct e820_entry *e = &e820_map[i];
+          if (e->type == E820_RAM && e->base <= end
+              && e->base + e->length > end)
+            {
+              end = e->base + e->length;
+              grew = true;
+            }
+        }
+    }
+  while (grew);
+
+  if (end > LOADER_RAM_MAX)
+    end = LOADER_RAM_MAX;
+  if (end > 1024 * 1024)
+    init_ram_pages = (uint32_t) end / PGSIZE;
+}
+
+/* Populates the base page directory with the kernel virtual
+   mapping, and then sets up the CPU to use the new page
+   directory.  Points init_page_dir to the page directory it
+   creates.
+
+   Most of RAM is mapped with 4 MB pages, which start.S enabled,
+   so it takes one PDE and no page table per 4 MB.  The 4 MB that
+   contain the kernel's code, which is mapped read-only, and the
+   last 4 MB of RAM, if RAM does not fill it, are mapped with
+   page tables of 4 kB pages instead.
+
+   All of these mappings are global, so if the CPU supports
+   global pages we turn them on.  Then the CR3 reload in
+   pagedir_activate() on each process switch flushes only user
+   translations from the TLB, and kernel translations survive.
+   See [IA32-v3a] "Translation Lookaside Buffers (TLBs)". */
 static void
 paging_init (void)
 {
-  uint32_t *pd, *pt;
-  size_t page;
+  uint32_t *pd;
+  uintptr_t ram_end = (uintptr_t) init_ram_pages * PGSIZE;
+  uintptr_t paddr;
   extern char _start, _end_kernel_text;
 
-  pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
-  pt = NULL;
-  for (page = 0; page < init_ram_pages; page++)
+  pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO
+                                        | PAL_PAGETABLE);
+  for (paddr = 0; paddr < ram_end; paddr += PTSPAN)
     {
-      uintptr_t paddr = page * PGSIZE;
       char *vaddr = ptov (paddr);
-      size_t pde_idx = pd_no (vaddr);
-      size_t pte_idx = pt_no (vaddr);
-      bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
+      bool has_kernel_text = (vaddr < &_end_kernel_text
+                              && &_start < vaddr + PTSPAN);
 
-      if (pd[pde_idx] == 0)
+      if (!has_kernel_text && paddr + PTSPAN <= ram_end)
+        pd[pd_no (vaddr)] = pde_create_large (paddr);
+      else
         {
-          pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
-          pd[pde_idx] = pde_create (pt);
+          uint32_t *pt = palloc_get_page (PAL_ASSERT | PAL_ZERO
+                                          | PAL_PAGETABLE);
+          size_t i;
+
+          for (i = 0; i < PTSPAN / PGSIZE && paddr + i * PGSIZE < ram_end;
+               i++)
+            {
+              char *page = vaddr + i * PGSIZE;
+              bool in_kernel_text = (&_start <= page
+                                     && page < &_end_kernel_text);
+              pt[i] = pte_create_kernel (page, !in_kernel_text);
+            }
+          pd[pd_no (vaddr)] = pde_create (pt);
         }
-
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
     }
 
   /* Store the physical address of the page directory into CR3
@@ -186,6 +265,10 @@ paging_init (void)
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+
+  /* Global pages must be enabled after paging. */
+  if (cpu_features () & CPUID_PGE)
+    cpu_write_cr4 (cpu_read_cr4 () | CR4_PGE);
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -256,9 +339,19 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
+      else if (!strcmp (name, "-tcache"))
+        thread_page_cache_max = parse_count (name, value);
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+      else if (!strcmp (name, "-loan"))
+        palloc_loan_chunk = parse_count (name, value);
+      else if (!strcmp (name, "-kfloor"))
+        palloc_kernel_floor = parse_count (name, value);
+      else if (!strcmp (name, "-ufloor"))
+        palloc_user_floor = parse_count (name, value);
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -277,6 +370,30 @@ parse_options (char **argv)
   return argv;
 }
 
+/* Returns VALUE, the argument to option NAME, as a count.
+   Panics if VALUE is missing, is not a non-negative decimal
+   integer, or does not fit in a size_t. */
+static size_t
+parse_count (const char *name, const char *value)
+{
+  const char *p = value;
+  size_t count = 0;
+
+  if (p == NULL || *p == '\0')
+    PANIC ("option `%s' requires a count", name);
+  for (; *p != '\0'; p++)
+    {
+      size_t digit = *p - '0';
+      if (!isdigit (*p))
+        PANIC ("option `%s': `%s' is not a non-negative integer",
+               name, value);
+      if (count > (SIZE_MAX - digit) / 10)
+        PANIC ("option `%s': `%s' is out of range", name, value);
+      count = count * 10 + digit;
+    }
+  return count;
+}
+
 /* Runs the task specified in ARGV[1]. */
 static void
 run_task (char **argv)
@@ -292,6 +409,25 @@ run_task (char **argv)
   printf ("Execution of '%s' complete.\n", task);
 }
 
+/* Prints scheduling statistics for each thread. */
+static void
+print_sched_stats (char **argv UNUSED)
+{
+  thread_print_sched_stats ();
+}
+
+/* Prints where kernel and user memory is going: pages in use by
+   owner, slab usage by cache, malloc() call sites, and vmalloc()
+   usage. */
+static void
+print_meminfo (char **argv UNUSED)
+{
+  palloc_print_stats ();
+  slab_print_stats ();
+  malloc_print_stats ();
+  vmalloc_print_stats ();
+}
+
 /* Executes all of the actions specified in ARGV[]
    up to the null pointer sentinel. */
 static void
@@ -309,6 +445,8 @@ run_actions (char **argv)
   static const struct action actions[] = 
     {
       {"run", 2, run_task},
+      {"schedstat", 1, print_sched_stats},
+      {"meminfo", 1, print_meminfo},
 #ifdef FILESYS
       {"ls", 1, fsutil_ls},
       {"cat", 2, fsutil_cat},
@@ -357,6 +495,8 @@ usage (void)
 #else
           "  run TEST           Run TEST.\n"
 #endif
+          "  schedstat          Print per-thread scheduling statistics.\n"
+          "  meminfo            Print memory usage by owner.\n"
 #ifdef FILESYS
           "  ls                 List files in the root directory.\n"
           "  cat FILE           Print FILE to the console.\n"
@@ -379,8 +519,13 @@ usage (void)
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -tickless          Stop the periodic timer tick while idle.\n"
+          "  -tcache=COUNT      Keep up to COUNT dead threads' pages for reuse.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+          "  -loan=COUNT        Lend COUNT pages at a time between pools.\n"
+          "  -kfloor=COUNT      Keep COUNT free kernel pages when lending.\n"
+          "  -ufloor=COUNT      Keep COUNT free user pages when lending.\n"
 #endif
           );
   shutdown_power_off ();
@@ -227,6 +227,28 @@ intr_yield_on_return (void)
 
 /* 8259A Programmable Interrupt Controller. */
 
+/* Returns true if external interrupt VEC_NO has been raised by
+   its device but not yet delivered to the CPU, as happens while
+   interrupts are disabled. */
+bool
+intr_ext_pending (uint8_t vec_no)
+{
+  int port = vec_no >= 0x28 ? PIC1_CTRL : PIC0_CTRL;
+  enum intr_level old_level;
+  uint8_t irr;
+
+  ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+
+  /* OCW3: make the next read of the control port return the
+     interrupt request register. */
+  old_level = intr_disable ();
+  outb (port, 0x0a);
+  irr = inb (port);
+  intr_set_level (old_level);
+
+  return (irr & (1 << (vec_no & 7))) != 0;
+}
+
 /* Initializes the PICs.  Refer to [8259A] for details.
 
    By default, interrupts 0...15 delivered by the PICs will go to
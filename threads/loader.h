@@ -12,6 +12,18 @@
    Must be aligned on a 4 MB boundary. */
 #define LOADER_PHYS_BASE 0xc0000000     /* 3 GB. */
 
+/* Maximum amount of physical memory the kernel uses.  All of it
+   is mapped starting at LOADER_PHYS_BASE, which must leave room
+   above it for the vmalloc region (see threads/vaddr.h).  Must be
+   a multiple of 4 MB. */
+#define LOADER_RAM_MAX 0x38000000       /* 896 MB. */
+
+/* BIOS memory map, obtained by start.S with interrupt 15h
+   function e820h. */
+#define E820_MAX 32             /* Maximum number of regions recorded. */
+#define E820_ENTRY_SIZE 20      /* Size of a struct e820_entry. */
+#define E820_RAM 1              /* Region type for usable RAM. */
+
 /* Important loader physical addresses. */
 #define LOADER_SIG (LOADER_END - LOADER_SIG_LEN)   /* 0xaa55 BIOS signature. */
 #define LOADER_PARTS (LOADER_SIG - LOADER_PARTS_LEN)     /* Partition table. */
@@ -35,6 +47,19 @@
 
 /* Amount of physical memory, in 4 kB pages. */
 extern uint32_t init_ram_pages;
+
+/* A region of physical memory, as reported by the BIOS. */
+struct e820_entry
+  {
+    uint64_t base;              /* Physical address. */
+    uint64_t length;            /* Size in bytes. */
+    uint32_t type;              /* E820_RAM or a kind of reserved. */
+  }
+__attribute__ ((packed));
+
+/* The BIOS memory map, in the order the BIOS reported it. */
+extern struct e820_entry e820_map[E820_MAX];
+extern uint32_t e820_cnt;
 #endif
 
 #endif /* threads/loader.h */
@@ -1,86 +1,112 @@
 #include "threads/malloc.h"
 #include <debug.h>
-#include <list.h>
 #include <round.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
-#include "threads/synch.h"
+#include "threads/slab.h"
 #include "threads/vaddr.h"
+#include "threads/vmalloc.h"
 
 /* A simple implementation of malloc().
 
-   The size of each request, in bytes, is rounded up to a power
-   of 2 and assigned to the "descriptor" that manages blocks of
-   that size.  The descriptor keeps a list of free blocks.  If
-   the free list is nonempty, one of its blocks is used to
-   satisfy the request.
-
-   Otherwise, a new page of memory, called an "arena", is
-   obtained from the page allocator (if none is available,
-   malloc() returns a null pointer).  The new arena is divided
-   into blocks, all of which are added to the descriptor's free
-   list.  Then we return one of the new blocks.
-
-   When we free a block, we add it to its descriptor's free list.
-   But if the arena that the block was in now has no in-use
-   blocks, we remove all of the arena's blocks from the free list
-   and give the arena back to the page allocator.
-
-   We can't handle blocks bigger than 2 kB using this scheme,
-   because they're too big to fit in a single page with a
-   descriptor.  We handle those by allocating contiguous pages
-   with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
-
-/* Descriptor. */
-struct desc
-  {
-    size_t block_size;          /* Size of each element in bytes. */
-    size_t blocks_per_arena;    /* Number of blocks in an arena. */
-    struct list free_list;      /* List of free blocks. */
-    struct lock lock;           /* Lock. */
-  };
+   The size of each request, in bytes, is rounded up to the
+   nearest of a fixed set of size classes and assigned to the
+   object cache (see slab.c) that manages blocks of that size.
+   The classes are spaced more finely than powers of 2, so that,
+   for example, a 24-byte request uses a 24-byte block rather
+   than a 32-byte one.
+
+   We can't handle blocks bigger than 1 kB using this scheme,
+   because too few of them would fit in a single page.  We handle
+   those by allocating contiguous pages with the page allocator
+   and sticking the allocation size at the beginning of the
+   allocated block's arena header.  If that many contiguous pages
+   cannot be found, the pages come from vmalloc() instead, which
+   does not need them to be physically contiguous.
+
+   When the kernel is built with MALLOC_DEBUG defined (see
+   Makefile.build), malloc(), calloc(), and realloc() also count
+   the allocations made from each call site, identified by its
+   return address, and malloc_print_stats() prints the counts.
+   The "backtrace" utility turns the addresses into function
+   names and line numbers. */
 
 /* Magic number for detecting arena corruption. */
 #define ARENA_MAGIC 0x9a548eed
 
-/* Arena. */
+/* Arena for a big block. */
 struct arena 
   {
     unsigned magic;             /* Always set to ARENA_MAGIC. */
-    struct desc *desc;          /* Owning descriptor, null for big block. */
-    size_t free_cnt;            /* Free blocks; pages in big block. */
+    size_t page_cnt;            /* Number of pages in block. */
   };
 
-/* Free block. */
-struct block 
+/* Size classes, in bytes.  Each is a multiple of 8, so that
+   every block is 8-byte aligned. */
+static const size_t size_classes[] =
+  {
+    8, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024,
+  };
+#define SIZE_CLASS_CNT (sizeof size_classes / sizeof *size_classes)
+#define SIZE_CLASS_MAX 1024
+
+/* Object cache for each size class. */
+static struct kmem_cache *size_caches[SIZE_CLASS_CNT];
+
+/* Maps (SIZE - 1) / 8, for SIZE up to SIZE_CLASS_MAX, to the
+   index of the smallest size class that holds SIZE bytes. */
+static uint8_t size_index[SIZE_CLASS_MAX / 8];
+
+static struct arena *block_to_arena (void *);
+static void *alloc_block (size_t);
+
+#ifdef MALLOC_DEBUG
+/* Maximum number of call sites counted. */
+#define CALLSITE_MAX 128
+
+/* Allocations from one call site. */
+struct callsite
   {
-    struct list_elem free_elem; /* Free list element. */
+    const void *caller;         /* Return address, or null if unused. */
+    unsigned long long allocs;  /* Number of allocations. */
+    unsigned long long bytes;   /* Total bytes requested. */
   };
 
-/* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
-static size_t desc_cnt;         /* Number of descriptors. */
+/* Call sites, hashed on their return addresses.  Accessed with
+   interrupts off. */
+static struct callsite callsites[CALLSITE_MAX];
 
-static struct arena *block_to_arena (struct block *);
-static struct block *arena_to_block (struct arena *, size_t idx);
+/* Allocations from call sites that did not fit in callsites[]. */
+static unsigned long long untracked_allocs;
+
+static void count_callsite (const void *caller, size_t size);
+#define COUNT_CALLSITE(SIZE) \
+        count_callsite (__builtin_return_address (0), SIZE)
+#else
+#define COUNT_CALLSITE(SIZE) ((void) 0)
+#endif
 
-/* Initializes the malloc() descriptors. */
+/* Initializes the slab allocator and malloc()'s size
+   classes. */
 void
 malloc_init (void) 
 {
-  size_t block_size;
+  size_t i, j;
 
-  for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
+  slab_init ();
+  for (i = j = 0; i < SIZE_CLASS_CNT; i++)
     {
-      struct desc *d = &descs[desc_cnt++];
-      ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
-      d->block_size = block_size;
-      d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
-      list_init (&d->free_list);
-      lock_init (&d->lock);
+      char name[16];
+
+      snprintf (name, sizeof name, "size-%zu", size_classes[i]);
+      size_caches[i] = kmem_cache_create (name, size_classes[i], 8);
+      if (size_caches[i] == NULL)
+        PANIC ("out of memory creating malloc size classes");
+      for (; j < size_classes[i] / 8; j++)
+        size_index[j] = i;
     }
 }
 
@@ -89,68 +115,38 @@ malloc_init (void)
 void *
 malloc (size_t size) 
 {
-  struct desc *d;
-  struct block *b;
+  COUNT_CALLSITE (size);
+  return alloc_block (size);
+}
+
+/* Does the work of malloc(). */
+static void *
+alloc_block (size_t size)
+{
   struct arena *a;
+  size_t page_cnt;
 
   /* A null pointer satisfies a request for 0 bytes. */
   if (size == 0)
     return NULL;
 
-  /* Find the smallest descriptor that satisfies a SIZE-byte
-     request. */
-  for (d = descs; d < descs + desc_cnt; d++)
-    if (d->block_size >= size)
-      break;
-  if (d == descs + desc_cnt) 
-    {
-      /* SIZE is too big for any descriptor.
-         Allocate enough pages to hold SIZE plus an arena. */
-      size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
-      a = palloc_get_multiple (0, page_cnt);
-      if (a == NULL)
-        return NULL;
-
-      /* Initialize the arena to indicate a big block of PAGE_CNT
-         pages, and return it. */
-      a->magic = ARENA_MAGIC;
-      a->desc = NULL;
-      a->free_cnt = page_cnt;
-      return a + 1;
-    }
+  if (size <= SIZE_CLASS_MAX)
+    return kmem_cache_alloc (size_caches[size_index[(size - 1) / 8]]);
 
-  lock_acquire (&d->lock);
-
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
-    {
-      size_t i;
-
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL) 
-        {
-          lock_release (&d->lock);
-          return NULL; 
-        }
-
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++) 
-        {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
-        }
-    }
+  /* SIZE is too big for any size class.
+     Allocate enough pages to hold SIZE plus an arena. */
+  page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
+  a = palloc_get_multiple (PAL_MALLOC, page_cnt);
+  if (a == NULL && page_cnt > 1)
+    a = vmalloc (PGSIZE * page_cnt);
+  if (a == NULL)
+    return NULL;
 
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
-  lock_release (&d->lock);
-  return b;
+  /* Initialize the arena to indicate a big block of PAGE_CNT
+     pages, and return it. */
+  a->magic = ARENA_MAGIC;
+  a->page_cnt = page_cnt;
+  return a + 1;
 }
 
 /* Allocates and return A times B bytes initialized to zeroes.
@@ -167,7 +163,8 @@ calloc (size_t a, size_t b)
     return NULL;
 
   /* Allocate and zero memory. */
-  p = malloc (size);
+  COUNT_CALLSITE (size);
+  p = alloc_block (size);
   if (p != NULL)
     memset (p, 0, size);
 
@@ -178,11 +175,12 @@ calloc (size_t a, size_t b)
 static size_t
 block_size (void *block) 
 {
-  struct block *b = block;
-  struct arena *a = block_to_arena (b);
-  struct desc *d = a->desc;
+  struct kmem_cache *c = kmem_cache_of (block);
 
-  return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
+  if (c != NULL)
+    return kmem_cache_size (c);
+  else
+    return PGSIZE * block_to_arena (block)->page_cnt - pg_ofs (block);
 }
 
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
@@ -201,7 +199,10 @@ realloc (void *old_block, size_t new_size)
     }
   else 
     {
-      void *new_block = malloc (new_size);
+      void *new_block;
+
+      COUNT_CALLSITE (new_size);
+      new_block = alloc_block (new_size);
       if (old_block != NULL && new_block != NULL)
         {
           size_t old_size = block_size (old_block);
@@ -220,52 +221,77 @@ free (void *p)
 {
   if (p != NULL)
     {
-      struct block *b = p;
-      struct arena *a = block_to_arena (b);
-      struct desc *d = a->desc;
-      
-      if (d != NULL) 
-        {
-          /* It's a normal block.  We handle it here. */
+      struct kmem_cache *c = kmem_cache_of (p);
 
-#ifndef NDEBUG
-          /* Clear the block to help detect use-after-free bugs. */
-          memset (b, 0xcc, d->block_size);
-#endif
-  
-          lock_acquire (&d->lock);
-
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
-
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
-            {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
-            }
-
-          lock_release (&d->lock);
-        }
+      if (c != NULL)
+        kmem_cache_free (c, p);
       else
         {
           /* It's a big block.  Free its pages. */
-          palloc_free_multiple (a, a->free_cnt);
+          struct arena *a = block_to_arena (p);
+          if (is_vmalloc_addr (a))
+            vfree (a);
+          else
+            palloc_free_multiple (a, a->page_cnt);
+        }
+    }
+}
+
+/* Prints the number of allocations made from each call site,
+   if the kernel was built with MALLOC_DEBUG defined. */
+void
+malloc_print_stats (void)
+{
+#ifdef MALLOC_DEBUG
+  size_t i;
+
+  for (i = 0; i < CALLSITE_MAX; i++)
+    {
+      enum intr_level old_level = intr_disable ();
+      struct callsite cs = callsites[i];
+      intr_set_level (old_level);
+
+      if (cs.caller != NULL)
+        printf ("Malloc: caller %p: %llu allocations, %llu bytes\n",
+                cs.caller, cs.allocs, cs.bytes);
+    }
+  if (untracked_allocs != 0)
+    printf ("Malloc: %llu allocations from untracked callers\n",
+            untracked_allocs);
+#endif
+}
+
+#ifdef MALLOC_DEBUG
+/* Counts an allocation of SIZE bytes made from the call site
+   that returns to CALLER. */
+static void
+count_callsite (const void *caller, size_t size)
+{
+  enum intr_level old_level = intr_disable ();
+  size_t start = (uintptr_t) caller % CALLSITE_MAX;
+  size_t i = start;
+
+  /* Linear probing. */
+  while (callsites[i].caller != caller && callsites[i].caller != NULL)
+    {
+      i = (i + 1) % CALLSITE_MAX;
+      if (i == start)
+        {
+          untracked_allocs++;
+          intr_set_level (old_level);
           return;
         }
     }
+  callsites[i].caller = caller;
+  callsites[i].allocs++;
+  callsites[i].bytes += size;
+  intr_set_level (old_level);
 }
-
-/* Returns the arena that block B is inside. */
+#endif
+
+/* Returns the arena of big block B. */
 static struct arena *
-block_to_arena (struct block *b)
+block_to_arena (void *b)
 {
   struct arena *a = pg_round_down (b);
 
@@ -274,21 +300,7 @@ block_to_arena (struct block *b)
   ASSERT (a->magic == ARENA_MAGIC);
 
   /* Check that the block is properly aligned for the arena. */
-  ASSERT (a->desc == NULL
-          || (pg_ofs (b) - sizeof *a) % a->desc->block_size == 0);
-  ASSERT (a->desc != NULL || pg_ofs (b) == sizeof *a);
+  ASSERT (pg_ofs (b) == sizeof *a);
 
   return a;
 }
-
-/* Returns the (IDX - 1)'th block within arena A. */
-static struct block *
-arena_to_block (struct arena *a, size_t idx) 
-{
-  ASSERT (a != NULL);
-  ASSERT (a->magic == ARENA_MAGIC);
-  ASSERT (idx < a->desc->blocks_per_arena);
-  return (struct block *) ((uint8_t *) a
-                           + sizeof *a
-                           + idx * a->desc->block_size);
-}
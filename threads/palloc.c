@@ -2,14 +2,22 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
+#ifdef USERPROG
+#include "threads/thread.h"
+#include "userprog/pagedir.h"
+#endif
+#ifdef VM
+#include "vm/frame.h"
+#endif
 
 /* Page allocator.  Hands out memory in page-size (or
    page-multiple) chunks.  See malloc.h for an allocator that
@@ -25,20 +33,199 @@
    half to the user pool.  That should be huge overkill for the
    kernel pool, but that's just fine for demonstration purposes. */
 
+/* Buddy allocation.
+
+   Each pool hands out blocks of 2**K pages, for "orders" K from
+   0 to MAX_ORDER, aligned on 2**K-page boundaries relative to the
+   start of the pool.  Free blocks of each order are kept on a
+   free list of their own, linked through a list_elem at the
+   start of the free block itself.  Allocating N pages takes a
+   block of the smallest order K with 2**K >= N, splitting a
+   larger block in halves ("buddies") as needed, and gives back
+   the unused pages at the end of the block right away.  Freeing
+   a block merges it with its buddy, if that is also free, and so
+   on up, so that free memory stays in blocks as large as
+   possible.  Both take time proportional to MAX_ORDER, not to
+   the size of the pool.
+
+   The pools' state is touched with interrupts off, instead of
+   under a sleeping lock, so that pages may be freed from
+   thread_schedule_tail() while switching away from a dying
+   thread.  This covers both pools at once, as it must, because
+   loans (see below) move pages between them. */
+
+/* Pre-zeroed pages.
+
+   Many callers ask for zeroed pages (PAL_ZERO), and zeroing a
+   page takes far longer than allocating it.  So, when it has
+   nothing better to do, the idle thread calls palloc_zero_idle()
+   to take single free pages out of the buddy allocator, zero
+   them, and keep them on a separate list, up to ZERO_POOL_MAX per
+   pool.  Single-page PAL_ZERO requests are served from that list
+   first.  The pages on it are still available to every request:
+   if the buddy allocator runs out, the zeroed pages are given
+   back to it and the allocation is retried. */
+
+/* Page accounting.
+
+   Each allocation is charged to an owner, given by the caller
+   in the PAL_OWNER_MASK bits of its flags, and the owner of each
+   allocated page is remembered in a byte map so that freeing it
+   credits the same owner.  Each pool keeps the number of pages
+   charged to each owner, and to all owners together, along with
+   the highest each count has reached, so that a leak (a count
+   that keeps growing) can be told from a high watermark.  Pages
+   held only as pre-zeroed pages are not charged to anyone. */
+
+/* Loans between pools.
+
+   The split of memory between the pools is fixed at boot, but
+   the demand on each is not, so a pool that runs out of pages
+   borrows from the other instead of failing.  When a pool
+   cannot satisfy a single-page request, it first takes back any
+   of its own pages that the other pool borrowed but is not
+   using, then borrows a chunk of palloc_loan_chunk pages (or as
+   many as the other pool can spare, keeping at least its floor
+   of free pages for itself) and hands them out one at a time.
+   Multi-page requests are never served from borrowed pages,
+   because a chunk need not be contiguous with the borrower's
+   own free blocks.
+
+   Borrowed pages stay in the lender's address range, charged to
+   OWNER_LENT in its accounting and marked with LENT_BIT in its
+   owner map, so that freeing one finds its way back to the
+   borrower.  The borrower keeps its free borrowed pages on a
+   list of its own for reuse until pressure on it eases, that
+   is, until it has a chunk's worth of free pages of its own
+   again, at which point it returns them all to the lender.
+
+   The user pool never borrows more pages than the -ul option
+   allows it in all. */
+
+/* Compaction.
+
+   Pages cannot otherwise move once allocated, so a pool whose
+   used pages are scattered cannot satisfy a multi-page request
+   even with plenty of pages free.  When that happens, the pool
+   looks for the aligned block of the needed order whose used
+   pages are all user pages, which can be moved, and picks the
+   one with the fewest.  It moves each of those pages to a new
+   page elsewhere, updating the page table entries that map it,
+   and frees the old page, which leaves the block free.  User
+   pages that a system call has pinned (see userprog/syscall.c)
+   are left alone, since it may hold kernel pointers into them,
+   and so are user pages that are not mapped yet.
+
+   With virtual memory, the frame table knows which page table
+   entries map each user page, so vm/frame.c's frame_migrate()
+   does the moving.  Without it, each process's page tables are
+   searched for the page.  Either way, interrupts are off only
+   while a single page is copied and remapped. */
+
+/* Page owners are numbered by the value of the PAL_OWNER_MASK
+   bits, shifted right by OWNER_SHIFT, followed by OWNER_USER for
+   user pool pages without an explicit owner. */
+#define OWNER_SHIFT 3
+#define OWNER_USER ((PAL_VMALLOC >> OWNER_SHIFT) + 1)
+#define OWNER_LENT (OWNER_USER + 1)
+#define OWNER_CNT (OWNER_LENT + 1)
+
+/* Set in a pool's owner map for pages lent to the other pool,
+   along with the owner that the borrower charged the page to. */
+#define LENT_BIT 0x80
+
+/* Names of the page owners, for reports. */
+static const char *owner_names[OWNER_CNT] =
+  {
+    "other", "thread stacks", "page tables", "slabs",
+    "malloc big blocks", "buffers", "vmalloc", "user pages",
+    "lent to other pool",
+  };
+
+/* Maximum number of pre-zeroed pages kept in each pool. */
+#define ZERO_POOL_MAX 64
+
+/* Largest block order: 2**12 pages, or 16 MB. */
+#define MAX_ORDER 12
+
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
     uint8_t *base;                      /* Base of pool. */
+    size_t page_cnt;                    /* Number of pages in pool. */
+    size_t free_cnt;                    /* Number of free pages. */
+    const char *name;                   /* Name (for debugging purposes). */
+
+    /* For each page that begins a free block of order K, K + 1;
+       otherwise, 0. */
+    uint8_t *block_order;
+
+    struct list free_lists[MAX_ORDER + 1]; /* Free blocks by order. */
+    size_t free_blocks[MAX_ORDER + 1];  /* Length of each free list. */
+
+    /* Pre-zeroed pages, linked through their first bytes, which
+       must be cleared again when a page is handed out. */
+    struct list zeroed;                 /* Zeroed pages. */
+    size_t zeroed_cnt;                  /* Number of pages in ZEROED. */
+    long long zero_hits;                /* PAL_ZERO served from ZEROED. */
+    long long zero_misses;              /* PAL_ZERO zeroed on demand. */
+    long long idle_zeroed;              /* Pages zeroed by idle thread. */
+
+    /* Page accounting. */
+    uint8_t *owner;                     /* Owner of each used page. */
+    size_t used_cnt;                    /* Pages charged to any owner. */
+    size_t used_peak;                   /* Maximum of USED_CNT. */
+    size_t owner_cnt[OWNER_CNT];        /* Pages charged to each owner. */
+    size_t owner_peak[OWNER_CNT];       /* Maximum of each OWNER_CNT. */
+
+    /* Loans. */
+    struct pool *other;                 /* The other pool. */
+    size_t floor;                       /* Free pages not to lend. */
+    size_t borrow_max;                  /* Most pages to borrow at once. */
+    size_t borrowed_cnt;                /* Pages borrowed from OTHER. */
+    struct list loaned;                 /* Free pages borrowed from OTHER. */
+    size_t loaned_cnt;                  /* Number of pages in LOANED. */
+    long long borrows;                  /* Number of chunks borrowed. */
+
+    /* Compaction. */
+    long long compactions;              /* Number of attempts. */
+    long long compact_failures;         /* Attempts that failed. */
+    long long pages_migrated;           /* Pages moved. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
+/* Loan parameters.  See palloc.h. */
+size_t palloc_loan_chunk = PALLOC_LOAN_CHUNK_DEFAULT;
+size_t palloc_kernel_floor = PALLOC_KERNEL_FLOOR_DEFAULT;
+size_t palloc_user_floor = PALLOC_USER_FLOOR_DEFAULT;
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t buddy_alloc (struct pool *, size_t page_cnt);
+static void buddy_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void free_block (struct pool *, size_t page_idx, int order);
+static void flush_zeroed (struct pool *);
+static bool zero_page (struct pool *);
+static int owner_of (struct pool *, enum palloc_flags);
+static void charge (struct pool *, size_t page_idx, size_t page_cnt,
+                    int owner);
+static void uncharge (struct pool *, size_t page_idx, size_t page_cnt);
+static void add_charge (struct pool *, int owner, size_t page_cnt);
+static void sub_charge (struct pool *, int owner, size_t page_cnt);
+static void *borrow_page (struct pool *, int owner);
+static bool borrow (struct pool *);
+static void free_borrowed (struct pool *, void *page);
+static void repay (struct pool *);
+static void *alloc_pages (struct pool *, enum palloc_flags, size_t page_cnt,
+                          bool *zeroed);
+#ifdef USERPROG
+static bool compact (struct pool *, size_t page_cnt);
+#endif
+static void print_pool_stats (struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -59,6 +246,15 @@ palloc_init (size_t user_page_limit)
   init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
   init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
              user_pages, "user pool");
+
+  /* Let each pool borrow from the other, but keep the user pool
+     within its limit. */
+  kernel_pool.other = &user_pool;
+  kernel_pool.floor = palloc_kernel_floor;
+  user_pool.other = &kernel_pool;
+  user_pool.floor = palloc_user_floor;
+  if (user_page_limit != SIZE_MAX)
+    user_pool.borrow_max = user_page_limit - user_pages;
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
@@ -72,23 +268,23 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
   void *pages;
-  size_t page_idx;
+  bool zeroed;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
-
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
-  else
-    pages = NULL;
+  pages = alloc_pages (pool, flags, page_cnt, &zeroed);
+#ifdef USERPROG
+  if (pages == NULL && page_cnt > 1 && !intr_context ()
+      && compact (pool, page_cnt))
+    pages = alloc_pages (pool, flags, page_cnt, &zeroed);
+#endif
 
   if (pages != NULL) 
     {
-      if (flags & PAL_ZERO)
+      if (zeroed)
+        memset (pages, 0, sizeof (struct list_elem));
+      else if (flags & PAL_ZERO)
         memset (pages, 0, PGSIZE * page_cnt);
     }
   else 
@@ -100,6 +296,55 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   return pages;
 }
 
+/* Allocates PAGE_CNT contiguous pages from POOL for an
+   allocation with the given FLAGS, and returns them, or a null
+   pointer if too few pages are available.  Sets *ZEROED to true
+   if the page came from POOL's pre-zeroed pages, false
+   otherwise. */
+static void *
+alloc_pages (struct pool *pool, enum palloc_flags flags, size_t page_cnt,
+             bool *zeroed)
+{
+  enum intr_level old_level;
+  void *pages = NULL;
+  size_t page_idx;
+
+  *zeroed = false;
+  old_level = intr_disable ();
+  if (page_cnt == 1 && (flags & PAL_ZERO) && !list_empty (&pool->zeroed))
+    {
+      pages = list_pop_front (&pool->zeroed);
+      pool->zeroed_cnt--;
+      pool->zero_hits++;
+      *zeroed = true;
+      charge (pool, pg_no (pages) - pg_no (pool->base), 1,
+              owner_of (pool, flags));
+    }
+  else
+    {
+      page_idx = buddy_alloc (pool, page_cnt);
+      if (page_idx == BITMAP_ERROR
+          && (pool->zeroed_cnt > 0 || pool->other->loaned_cnt > 0))
+        {
+          flush_zeroed (pool);
+          repay (pool->other);
+          page_idx = buddy_alloc (pool, page_cnt);
+        }
+      if (page_idx != BITMAP_ERROR)
+        {
+          pages = pool->base + PGSIZE * page_idx;
+          charge (pool, page_idx, page_cnt, owner_of (pool, flags));
+        }
+      else if (page_cnt == 1)
+        pages = borrow_page (pool, owner_of (pool, flags));
+      if (pages != NULL && (flags & PAL_ZERO))
+        pool->zero_misses++;
+    }
+  intr_set_level (old_level);
+
+  return pages;
+}
+
 /* Obtains a single free page and returns its kernel virtual
    address.
    If PAL_USER is set, the page is obtained from the user pool,
@@ -118,6 +363,7 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
@@ -137,8 +383,19 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = intr_disable ();
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  if (pool->owner[page_idx] & LENT_BIT)
+    {
+      ASSERT (page_cnt == 1);
+      free_borrowed (pool->other, pages);
+    }
+  else
+    {
+      uncharge (pool, page_idx, page_cnt);
+      buddy_free (pool, page_idx, page_cnt);
+    }
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -148,25 +405,114 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Zeroes one free page and adds it to the pre-zeroed pages of
+   a pool, preferring the pool that has fewer of them.  Returns
+   true if successful, false if neither pool needs or has a page
+   to zero.
+
+   Called by the idle thread with interrupts on. */
+bool
+palloc_zero_idle (void)
+{
+  ASSERT (intr_get_level () == INTR_ON);
+
+  if (user_pool.zeroed_cnt < kernel_pool.zeroed_cnt)
+    return zero_page (&user_pool) || zero_page (&kernel_pool);
+  else
+    return zero_page (&kernel_pool) || zero_page (&user_pool);
+}
+
+/* Zeroes one of POOL's free pages and adds it to POOL's
+   pre-zeroed pages.  Returns true if successful, false if POOL
+   already has ZERO_POOL_MAX zeroed pages or no free pages. */
+static bool
+zero_page (struct pool *pool)
+{
+  enum intr_level old_level;
+  size_t page_idx;
+  void *page;
+
+  if (pool->zeroed_cnt >= ZERO_POOL_MAX)
+    return false;
+
+  old_level = intr_disable ();
+  page_idx = pool->free_cnt > 0 ? buddy_alloc (pool, 1) : BITMAP_ERROR;
+  intr_set_level (old_level);
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  page = pool->base + PGSIZE * page_idx;
+  memset (page, 0, PGSIZE);
+
+  old_level = intr_disable ();
+  list_push_front (&pool->zeroed, page);
+  pool->zeroed_cnt++;
+  pool->idle_zeroed++;
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Prints statistics for both pools. */
+void
+palloc_print_stats (void)
+{
+  print_pool_stats (&kernel_pool);
+  print_pool_stats (&user_pool);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
+  /* We'll put the pool's used_map, block_order map, and owner
+     map at its base.  Calculate the space needed for them and
+     subtract it from the pool's size.  Each page costs one bit in
+     the bitmap and one byte in each of the other maps, so it is
+     enough to size the maps for the pool as a whole. */
+  size_t bm_size = ROUND_UP (bitmap_buf_size (page_cnt), sizeof (long));
+  size_t meta_pages = DIV_ROUND_UP (bm_size + 2 * page_cnt, PGSIZE);
+  int order;
+
+  if (meta_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  page_cnt -= meta_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  p->block_order = (uint8_t *) base + bm_size;
+  memset (p->block_order, 0, page_cnt);
+  p->owner = p->block_order + page_cnt;
+  p->used_cnt = p->used_peak = 0;
+  memset (p->owner_cnt, 0, sizeof p->owner_cnt);
+  memset (p->owner_peak, 0, sizeof p->owner_peak);
+  p->base = base + meta_pages * PGSIZE;
+  p->page_cnt = page_cnt;
+  p->free_cnt = 0;
+  p->name = name;
+  for (order = 0; order <= MAX_ORDER; order++)
+    {
+      list_init (&p->free_lists[order]);
+      p->free_blocks[order] = 0;
+    }
+  list_init (&p->zeroed);
+  p->zeroed_cnt = 0;
+  p->zero_hits = p->zero_misses = p->idle_zeroed = 0;
+  p->other = NULL;
+  p->floor = 0;
+  p->borrow_max = SIZE_MAX;
+  p->borrowed_cnt = 0;
+  list_init (&p->loaned);
+  p->loaned_cnt = 0;
+  p->borrows = 0;
+  p->compactions = p->compact_failures = p->pages_migrated = 0;
+
+  /* Mark every page used, then free them all, which puts them
+     into the largest blocks possible. */
+  bitmap_set_all (p->used_map, true);
+  buddy_free (p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -180,3 +526,592 @@ page_from_pool (const struct pool *pool, void *page)
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the smallest order whose blocks hold PAGE_CNT
+   pages. */
+static int
+order_for (size_t page_cnt)
+{
+  int order = 0;
+
+  while (((size_t) 1 << order) < page_cnt)
+    order++;
+  return order;
+}
+
+/* Returns the list element at the start of page PAGE_IDX in
+   POOL, which must begin a free block. */
+static struct list_elem *
+block_elem (struct pool *pool, size_t page_idx)
+{
+  return (struct list_elem *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Returns the index of the page that begins the free block with
+   list element E in POOL. */
+static size_t
+elem_block (struct pool *pool, struct list_elem *e)
+{
+  return ((uint8_t *) e - pool->base) / PGSIZE;
+}
+
+/* Removes the free block that begins at PAGE_IDX, of the given
+   ORDER, from POOL's free lists. */
+static void
+unlink_block (struct pool *pool, size_t page_idx, int order)
+{
+  ASSERT (pool->block_order[page_idx] == order + 1);
+
+  list_remove (block_elem (pool, page_idx));
+  pool->block_order[page_idx] = 0;
+  pool->free_blocks[order]--;
+  pool->free_cnt -= (size_t) 1 << order;
+}
+
+/* Adds the free block that begins at PAGE_IDX, of the given
+   ORDER, to POOL's free lists. */
+static void
+link_block (struct pool *pool, size_t page_idx, int order)
+{
+  list_push_front (&pool->free_lists[order], block_elem (pool, page_idx));
+  pool->block_order[page_idx] = order + 1;
+  pool->free_blocks[order]++;
+  pool->free_cnt += (size_t) 1 << order;
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first one, or BITMAP_ERROR if no free block is
+   big enough. */
+static size_t
+buddy_alloc (struct pool *pool, size_t page_cnt)
+{
+  size_t page_idx;
+  int order, k;
+
+  if (page_cnt > (size_t) 1 << MAX_ORDER)
+    return BITMAP_ERROR;
+  order = order_for (page_cnt);
+
+  /* Find the smallest free block that is big enough. */
+  for (k = order; k <= MAX_ORDER; k++)
+    if (!list_empty (&pool->free_lists[k]))
+      break;
+  if (k > MAX_ORDER)
+    return BITMAP_ERROR;
+  page_idx = elem_block (pool, list_front (&pool->free_lists[k]));
+  unlink_block (pool, page_idx, k);
+
+  /* Split it down to ORDER, freeing the upper halves. */
+  while (k > order)
+    {
+      k--;
+      link_block (pool, page_idx + ((size_t) 1 << k), k);
+    }
+
+  /* Mark the block used, then give back the pages beyond
+     PAGE_CNT. */
+  bitmap_set_multiple (pool->used_map, page_idx, (size_t) 1 << order, true);
+  if (page_cnt < (size_t) 1 << order)
+    buddy_free (pool, page_idx + page_cnt,
+                ((size_t) 1 << order) - page_cnt);
+  return page_idx;
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL, which
+   need not form a single block: the range is split into the
+   largest aligned blocks that it contains. */
+static void
+buddy_free (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  while (page_cnt > 0)
+    {
+      int order = 0;
+
+      while (order < MAX_ORDER
+             && page_idx % ((size_t) 2 << order) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Frees the block of the given ORDER that begins at PAGE_IDX in
+   POOL, merging it with its buddy as long as the buddy is free
+   too. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order)
+{
+  while (order < MAX_ORDER)
+    {
+      size_t buddy = page_idx ^ ((size_t) 1 << order);
+
+      if (buddy + ((size_t) 1 << order) > pool->page_cnt
+          || pool->block_order[buddy] != order + 1)
+        break;
+      unlink_block (pool, buddy, order);
+      if (buddy < page_idx)
+        page_idx = buddy;
+      order++;
+    }
+  link_block (pool, page_idx, order);
+}
+
+/* Returns all of POOL's pre-zeroed pages to its free lists. */
+static void
+flush_zeroed (struct pool *pool)
+{
+  while (!list_empty (&pool->zeroed))
+    {
+      struct list_elem *e = list_pop_front (&pool->zeroed);
+      ASSERT (bitmap_test (pool->used_map, elem_block (pool, e)));
+      buddy_free (pool, elem_block (pool, e), 1);
+    }
+  pool->zeroed_cnt = 0;
+}
+
+/* Returns the owner to charge for an allocation from POOL with
+   the given FLAGS. */
+static int
+owner_of (struct pool *pool, enum palloc_flags flags)
+{
+  int owner = (flags & PAL_OWNER_MASK) >> OWNER_SHIFT;
+
+  ASSERT (owner < OWNER_USER);
+  if (owner == 0 && pool == &user_pool)
+    owner = OWNER_USER;
+  return owner;
+}
+
+/* Charges the PAGE_CNT pages starting at PAGE_IDX in POOL to
+   OWNER.  Interrupts must be off. */
+static void
+charge (struct pool *pool, size_t page_idx, size_t page_cnt, int owner)
+{
+  memset (pool->owner + page_idx, owner, page_cnt);
+  add_charge (pool, owner, page_cnt);
+}
+
+/* Credits the PAGE_CNT pages starting at PAGE_IDX in POOL back
+   to the owners they were charged to.  Interrupts must be
+   off. */
+static void
+uncharge (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    sub_charge (pool, pool->owner[page_idx + i], 1);
+}
+
+/* Adds PAGE_CNT to the pages charged to OWNER in POOL. */
+static void
+add_charge (struct pool *pool, int owner, size_t page_cnt)
+{
+  pool->used_cnt += page_cnt;
+  if (pool->used_cnt > pool->used_peak)
+    pool->used_peak = pool->used_cnt;
+  pool->owner_cnt[owner] += page_cnt;
+  if (pool->owner_cnt[owner] > pool->owner_peak[owner])
+    pool->owner_peak[owner] = pool->owner_cnt[owner];
+}
+
+/* Subtracts PAGE_CNT from the pages charged to OWNER in POOL. */
+static void
+sub_charge (struct pool *pool, int owner, size_t page_cnt)
+{
+  ASSERT (owner < OWNER_CNT);
+  ASSERT (pool->owner_cnt[owner] >= page_cnt);
+  pool->owner_cnt[owner] -= page_cnt;
+  pool->used_cnt -= page_cnt;
+}
+
+/* Returns the index in LENDER of PAGE, which must be one of the
+   pages it lent. */
+static size_t
+lent_page_idx (struct pool *lender, void *page)
+{
+  size_t page_idx = pg_no (page) - pg_no (lender->base);
+
+  ASSERT (page_from_pool (lender, page));
+  ASSERT (lender->owner[page_idx] & LENT_BIT);
+  return page_idx;
+}
+
+/* Allocates a page for POOL from the pages it has borrowed from
+   the other pool, borrowing more if it has none free, and
+   charges it to OWNER.  Returns the page, or a null pointer if
+   the other pool has none to spare.  Interrupts must be off. */
+static void *
+borrow_page (struct pool *pool, int owner)
+{
+  struct pool *lender = pool->other;
+  void *page;
+
+  if (list_empty (&pool->loaned) && !borrow (pool))
+    return NULL;
+
+  page = list_pop_front (&pool->loaned);
+  pool->loaned_cnt--;
+  lender->owner[lent_page_idx (lender, page)] = LENT_BIT | owner;
+  add_charge (pool, owner, 1);
+  return page;
+}
+
+/* Borrows up to palloc_loan_chunk free pages from the other
+   pool and adds them to POOL's free borrowed pages, leaving the
+   other pool at least its floor of free pages.  Returns true if
+   successful, false if the other pool has no pages to spare.
+   Interrupts must be off. */
+static bool
+borrow (struct pool *pool)
+{
+  struct pool *lender = pool->other;
+  size_t page_cnt = palloc_loan_chunk;
+  size_t page_idx = BITMAP_ERROR;
+  size_t i;
+
+  if (page_cnt > pool->borrow_max - pool->borrowed_cnt)
+    page_cnt = pool->borrow_max - pool->borrowed_cnt;
+  if (lender->free_cnt <= lender->floor)
+    return false;
+  if (page_cnt > lender->free_cnt - lender->floor)
+    page_cnt = lender->free_cnt - lender->floor;
+
+  /* The lender's free memory may be fragmented, so settle for
+     less if need be. */
+  for (; page_cnt > 0; page_cnt /= 2)
+    {
+      page_idx = buddy_alloc (lender, page_cnt);
+      if (page_idx != BITMAP_ERROR)
+        break;
+    }
+  if (page_cnt == 0)
+    return false;
+
+  memset (lender->owner + page_idx, LENT_BIT, page_cnt);
+  add_charge (lender, OWNER_LENT, page_cnt);
+  for (i = 0; i < page_cnt; i++)
+    list_push_back (&pool->loaned,
+                    block_elem (lender, page_idx + i));
+  pool->loaned_cnt += page_cnt;
+  pool->borrowed_cnt += page_cnt;
+  pool->borrows++;
+  return true;
+}
+
+/* Frees PAGE, which POOL borrowed from the other pool, keeping
+   it for reuse by POOL.  If POOL has a chunk's worth of free
+   pages of its own again, returns all of its free borrowed
+   pages to the other pool.  Interrupts must be off. */
+static void
+free_borrowed (struct pool *pool, void *page)
+{
+  struct pool *lender = pool->other;
+  size_t page_idx = lent_page_idx (lender, page);
+
+  sub_charge (pool, lender->owner[page_idx] & ~LENT_BIT, 1);
+  lender->owner[page_idx] = LENT_BIT;
+  list_push_front (&pool->loaned, page);
+  pool->loaned_cnt++;
+
+  if (pool->free_cnt + pool->zeroed_cnt >= palloc_loan_chunk)
+    repay (pool);
+}
+
+/* Returns all of the free pages that POOL has borrowed to the
+   other pool.  Interrupts must be off. */
+static void
+repay (struct pool *pool)
+{
+  struct pool *lender = pool->other;
+
+  while (!list_empty (&pool->loaned))
+    {
+      void *page = list_pop_front (&pool->loaned);
+      size_t page_idx = lent_page_idx (lender, page);
+
+      ASSERT (lender->owner[page_idx] == LENT_BIT);
+      sub_charge (lender, OWNER_LENT, 1);
+      buddy_free (lender, page_idx, 1);
+    }
+  pool->borrowed_cnt -= pool->loaned_cnt;
+  pool->loaned_cnt = 0;
+}
+
+#ifdef USERPROG
+/* Returns true if page PAGE_IDX in POOL, which must be in use,
+   is a user page and thus may be moved. */
+static bool
+page_movable (const struct pool *pool, size_t page_idx)
+{
+  return (pool->owner[page_idx] & ~LENT_BIT) == OWNER_USER;
+}
+
+/* Returns the index of the first page in the block of the given
+   ORDER in POOL that has the fewest pages in use, considering
+   only blocks whose pages in use may all be moved.  Returns
+   BITMAP_ERROR if there is no such block.  Interrupts must be
+   off. */
+static size_t
+find_movable_block (struct pool *pool, int order)
+{
+  size_t block_pages = (size_t) 1 << order;
+  size_t best = BITMAP_ERROR;
+  size_t best_used = SIZE_MAX;
+  size_t start;
+
+  for (start = 0; start + block_pages <= pool->page_cnt;
+       start += block_pages)
+    {
+      size_t used = bitmap_count (pool->used_map, start, block_pages, true);
+      size_t i;
+
+      if (used >= best_used)
+        continue;
+      for (i = start; i < start + block_pages; i++)
+        if (bitmap_test (pool->used_map, i) && !page_movable (pool, i))
+          break;
+      if (i == start + block_pages)
+        {
+          best = start;
+          best_used = used;
+        }
+    }
+  return best;
+}
+
+#ifndef VM
+/* Information passed to check_pinned() and remap_thread(). */
+struct migration
+  {
+    void *page;                 /* Page being moved. */
+    void *new_page;             /* Where it is going. */
+    bool pinned;                /* Pinned by a system call? */
+    bool mapped;                /* Mapped by any thread? */
+  };
+
+/* Sets M->pinned if thread T's current system call has pinned a
+   user page that is at M->page. */
+static void
+check_pinned (struct thread *t, void *m_)
+{
+  struct migration *m = m_;
+  int i;
+
+  if (t->pagedir == NULL)
+    return;
+  for (i = 0; i < t->pin_cnt; i++)
+    {
+      const struct pin_range *r = &t->pins[i];
+      size_t j;
+
+      for (j = 0; j < r->page_cnt; j++)
+        if (pagedir_get_page (t->pagedir, r->upage + PGSIZE * j) == m->page)
+          m->pinned = true;
+    }
+}
+
+/* Points thread T's mappings of M->page to M->new_page. */
+static void
+remap_thread (struct thread *t, void *m_)
+{
+  struct migration *m = m_;
+
+  if (t->pagedir != NULL
+      && pagedir_remap_frame (t->pagedir, m->page, m->new_page))
+    m->mapped = true;
+}
+
+/* Moves user page PAGE to NEW_PAGE, updating every page table
+   entry that maps it, and frees PAGE.  Returns true if
+   successful.  If PAGE is not mapped by any process, or a
+   system call has pinned it, leaves it alone and returns false,
+   and the caller keeps NEW_PAGE. */
+static bool
+migrate_page (void *page, void *new_page)
+{
+  struct migration m;
+  enum intr_level old_level;
+
+  m.page = page;
+  m.new_page = new_page;
+  m.pinned = m.mapped = false;
+
+  /* No thread may run while the page is copied and remapped. */
+  old_level = intr_disable ();
+  thread_foreach (check_pinned, &m);
+  if (!m.pinned)
+    {
+      memcpy (new_page, page, PGSIZE);
+      thread_foreach (remap_thread, &m);
+    }
+  intr_set_level (old_level);
+
+  if (m.mapped)
+    palloc_free_page (page);
+  return m.mapped;
+}
+#else /* VM */
+/* Moves user page PAGE to NEW_PAGE through the frame table,
+   which updates every page table entry that maps it, and frees
+   PAGE.  Returns true if successful.  If the frame table cannot
+   move PAGE, leaves it alone and returns false, and the caller
+   keeps NEW_PAGE. */
+static bool
+migrate_page (void *page, void *new_page)
+{
+  if (!frame_migrate (page, new_page))
+    return false;
+  palloc_free_page (page);
+  return true;
+}
+#endif /* VM */
+
+/* Returns true if PAGE lies in the block of PAGE_CNT pages
+   starting at page START in POOL. */
+static bool
+page_in_block (struct pool *pool, void *page, size_t start, size_t page_cnt)
+{
+  size_t page_idx = pg_no (page) - pg_no (pool->base);
+  return page_from_pool (pool, page)
+         && page_idx >= start && page_idx < start + page_cnt;
+}
+
+/* Tries to make a free block of POOL big enough for PAGE_CNT
+   pages by moving the user pages out of it.  Returns true if
+   successful, false otherwise. */
+static bool
+compact (struct pool *pool, size_t page_cnt)
+{
+  int order = order_for (page_cnt);
+  size_t block_pages = (size_t) 1 << order;
+  enum intr_level old_level;
+  struct list held;
+  size_t start, i;
+  long long migrated = 0;
+  bool success;
+
+  if (order > MAX_ORDER)
+    return false;
+
+  old_level = intr_disable ();
+  pool->compactions++;
+  start = find_movable_block (pool, order);
+  intr_set_level (old_level);
+  if (start == BITMAP_ERROR)
+    goto done;
+
+  /* Move each page in use.  New pages that happen to come from
+     the block itself are held until we are done. */
+  list_init (&held);
+  for (i = start; i < start + block_pages; i++)
+    {
+      void *page = pool->base + PGSIZE * i;
+      void *new_page;
+
+      if (!bitmap_test (pool->used_map, i) || !page_movable (pool, i))
+        continue;
+      for (;;)
+        {
+          new_page = palloc_get_page (PAL_USER);
+          if (new_page == NULL || !page_in_block (pool, new_page,
+                                                  start, block_pages))
+            break;
+          list_push_back (&held, new_page);
+        }
+      if (new_page == NULL)
+        break;
+      if (migrate_page (page, new_page))
+        migrated++;
+      else
+        palloc_free_page (new_page);
+    }
+  while (!list_empty (&held))
+    palloc_free_page (list_pop_front (&held));
+
+ done:
+  /* Moving pages out of a block that the other pool had borrowed
+     from leaves them as free borrowed pages, so take them
+     back. */
+  old_level = intr_disable ();
+  repay (pool->other);
+  success = (start != BITMAP_ERROR
+             && !bitmap_contains (pool->used_map, start, block_pages,
+                                  true));
+  pool->pages_migrated += migrated;
+  if (!success)
+    pool->compact_failures++;
+  intr_set_level (old_level);
+  return success;
+}
+#endif /* USERPROG */
+
+/* Prints POOL's free page counts by block order, along with how
+   fragmented its free memory is: the percentage of free pages
+   that lie outside the largest free block.  Then prints the
+   number of pages in use, in all and by owner, with the peak of
+   each. */
+static void
+print_pool_stats (struct pool *pool)
+{
+  size_t free_blocks[MAX_ORDER + 1];
+  size_t owner_cnt[OWNER_CNT], owner_peak[OWNER_CNT];
+  size_t free_cnt, zeroed_cnt, used_cnt, used_peak, largest = 0;
+  size_t borrowed_cnt, loaned_cnt;
+  long long zero_hits, zero_misses, idle_zeroed, borrows;
+  long long compactions, compact_failures, pages_migrated;
+  enum intr_level old_level;
+  int order, owner;
+
+  old_level = intr_disable ();
+  memcpy (free_blocks, pool->free_blocks, sizeof free_blocks);
+  free_cnt = pool->free_cnt;
+  zeroed_cnt = pool->zeroed_cnt;
+  zero_hits = pool->zero_hits;
+  zero_misses = pool->zero_misses;
+  idle_zeroed = pool->idle_zeroed;
+  used_cnt = pool->used_cnt;
+  used_peak = pool->used_peak;
+  memcpy (owner_cnt, pool->owner_cnt, sizeof owner_cnt);
+  memcpy (owner_peak, pool->owner_peak, sizeof owner_peak);
+  borrowed_cnt = pool->borrowed_cnt;
+  loaned_cnt = pool->loaned_cnt;
+  borrows = pool->borrows;
+  compactions = pool->compactions;
+  compact_failures = pool->compact_failures;
+  pages_migrated = pool->pages_migrated;
+  intr_set_level (old_level);
+
+  for (order = 0; order <= MAX_ORDER; order++)
+    if (free_blocks[order] != 0)
+      largest = (size_t) 1 << order;
+
+  printf ("Palloc: %s: %zu of %zu pages free, %zu%% fragmented\n",
+          pool->name, free_cnt, pool->page_cnt,
+          free_cnt != 0 ? 100 - largest * 100 / free_cnt : 0);
+  printf ("Palloc: %s: free blocks by order:", pool->name);
+  for (order = 0; order <= MAX_ORDER; order++)
+    printf (" %zu", free_blocks[order]);
+  printf ("\n");
+  printf ("Palloc: %s: %zu pre-zeroed pages (%lld zeroed while idle), "
+          "%lld zeroed allocations from pool, %lld zeroed on demand\n",
+          pool->name, zeroed_cnt, idle_zeroed, zero_hits, zero_misses);
+  printf ("Palloc: %s: %zu pages in use (peak %zu)\n",
+          pool->name, used_cnt, used_peak);
+  for (owner = 0; owner < OWNER_CNT; owner++)
+    if (owner_peak[owner] != 0)
+      printf ("Palloc: %s: %s: %zu pages (peak %zu)\n",
+              pool->name, owner_names[owner], owner_cnt[owner],
+              owner_peak[owner]);
+  if (borrows != 0)
+    printf ("Palloc: %s: %zu pages borrowed from %s (%zu free), "
+            "%lld loans\n", pool->name, borrowed_cnt, pool->other->name,
+            loaned_cnt, borrows);
+  if (compactions != 0)
+    printf ("Palloc: %s: %lld compactions (%lld failed), "
+            "%lld pages migrated\n", pool->name, compactions,
+            compact_failures, pages_migrated);
+}
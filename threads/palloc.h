@@ -1,6 +1,7 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -8,13 +9,38 @@ enum palloc_flags
   {
     PAL_ASSERT = 001,           /* Panic on failure. */
     PAL_ZERO = 002,             /* Zero page contents. */
-    PAL_USER = 004              /* User page. */
+    PAL_USER = 004,             /* User page. */
+
+    /* What the pages are for, for accounting.  At most one may
+       be given.  Pages with none are charged to "other", or to
+       "user pages" if PAL_USER is set. */
+    PAL_STACK = 010,            /* Thread stack. */
+    PAL_PAGETABLE = 020,        /* Page directory or page table. */
+    PAL_SLAB = 030,             /* Slab for an object cache. */
+    PAL_MALLOC = 040,           /* Big block from malloc(). */
+    PAL_BUFFER = 050,           /* Temporary buffer. */
+    PAL_VMALLOC = 060,          /* Page of a vmalloc() buffer. */
+    PAL_OWNER_MASK = 070
   };
 
+/* Number of pages a pool borrows from the other at a time when
+   it runs out, and the number of free pages that the kernel and
+   user pools keep for themselves when lending.  Controlled by
+   kernel command-line options "-loan", "-kfloor", and
+   "-ufloor".  See palloc.c for details. */
+#define PALLOC_LOAN_CHUNK_DEFAULT 32
+#define PALLOC_KERNEL_FLOOR_DEFAULT 128
+#define PALLOC_USER_FLOOR_DEFAULT 64
+extern size_t palloc_loan_chunk;
+extern size_t palloc_kernel_floor;
+extern size_t palloc_user_floor;
+
 void palloc_init (size_t user_page_limit);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+bool palloc_zero_idle (void);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
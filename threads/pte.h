@@ -51,7 +51,9 @@ static inline uintptr_t pd_no (const void *va) {
    |         Physical Address           |         Flags          |
    +------------------------------------+------------------------+
 
-   In a PDE, the physical address points to a page table.
+   In a PDE, the physical address points to a page table, or,
+   if PTE_PS is set, to a 4 MB page, in which case bits 12...21 of
+   the address must be zero.
    In a PTE, the physical address points to a data or code page.
    The important flags are listed below.
    When a PDE or PTE is not "present", the other flags are
@@ -66,6 +68,8 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_U 0x4               /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20              /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80             /* 1=4 MB page, 0=page table (PDEs only). */
+#define PTE_G 0x100             /* 1=global, 0=flushed by CR3 load. */
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create (uint32_t *pt) {
@@ -73,20 +77,33 @@ static inline uint32_t pde_create (uint32_t *pt) {
   return vtop (pt) | PTE_U | PTE_P | PTE_W;
 }
 
+/* Returns a PDE that maps the 4 MB of physical memory starting
+   at PADDR, which must be 4 MB aligned, as a single global page.
+   The page is readable and writable, but only by ring 0 code.
+   CR4.PSE must be set for the CPU to honor the PDE. */
+static inline uint32_t pde_create_large (uintptr_t paddr) {
+  ASSERT ((paddr & (PTSPAN - 1)) == 0);
+  return paddr | PTE_G | PTE_PS | PTE_P | PTE_W;
+}
+
 /* Returns a pointer to the page table that page directory entry
-   PDE, which must "present", points to. */
+   PDE, which must "present" and must not map a 4 MB page, points
+   to. */
 static inline uint32_t *pde_get_pt (uint32_t pde) {
   ASSERT (pde & PTE_P);
+  ASSERT (!(pde & PTE_PS));
   return ptov (pde & PTE_ADDR);
 }
 
 /* Returns a PTE that points to PAGE.
    The PTE's page is readable.
    If WRITABLE is true then it will be writable as well.
-   The page will be usable only by ring 0 code (the kernel). */
+   The page will be usable only by ring 0 code (the kernel).
+   The PTE is global, because kernel mappings are the same in
+   every page directory. */
 static inline uint32_t pte_create_kernel (void *page, bool writable) {
   ASSERT (pg_ofs (page) == 0);
-  return vtop (page) | PTE_P | (writable ? PTE_W : 0);
+  return vtop (page) | PTE_G | PTE_P | (writable ? PTE_W : 0);
 }
 
 /* Returns a PTE that points to PAGE.
@@ -94,7 +111,8 @@ static inline uint32_t pte_create_kernel (void *page, bool writable) {
    If WRITABLE is true then it will be writable as well.
    The page will be usable by both user and kernel code. */
 static inline uint32_t pte_create_user (void *page, bool writable) {
-  return pte_create_kernel (page, writable) | PTE_U;
+  ASSERT (pg_ofs (page) == 0);
+  return vtop (page) | PTE_U | PTE_P | (writable ? PTE_W : 0);
 }
 
 /* Returns a pointer to the page that page table entry PTE points
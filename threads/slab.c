@@ -0,0 +1,377 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* A slab allocator, after Bonwick's "The Slab Allocator"
+   (USENIX 1994) and its magazine layer from Bonwick and Adams,
+   "Magazines and Vmem" (USENIX 2001).
+
+   An object cache hands out objects of a single fixed size.
+   Objects come from "slabs", each a single page obtained from
+   the page allocator, with a small header at its start followed
+   by as many objects as fit.  The free objects in a slab are
+   kept on a list threaded through their first word.  The cache
+   keeps the slabs that have free objects on its "partial" list,
+   forgets about slabs that are full until one of their objects
+   is freed, and holds on to at most one completely free slab,
+   returning others to the page allocator.  The slab layer is
+   protected by a per-cache lock.
+
+   In front of the slab layer, each cache has a pair of
+   "magazines", small stacks of free objects.  Allocation pops an
+   object from the loaded magazine and freeing pushes one onto
+   it, with interrupts off but without taking any lock.  When the
+   loaded magazine is empty (on allocation) or full (on free),
+   it is exchanged with the previous one, so that a thread that
+   alternates between allocating and freeing near a magazine
+   boundary doesn't thrash.  Only when both are empty does
+   allocation fall back to the slab layer, and only when both
+   are full does freeing return a magazine's worth of objects to
+   it.
+
+   Because an object's slab is found by rounding its address down
+   to a page boundary, objects may be at most a little less than
+   a page in size. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Maximum number of objects in a magazine. */
+#define MAG_SIZE 15
+
+/* A stack of free objects. */
+struct magazine
+  {
+    int rounds;                 /* Number of objects in objs[]. */
+    void *objs[MAG_SIZE];       /* Free objects. */
+  };
+
+/* An object cache. */
+struct kmem_cache
+  {
+    char name[16];              /* Name (for debugging purposes). */
+    size_t size;                /* Object size, rounded for alignment. */
+    size_t first_ofs;           /* Offset of first object in a slab. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    int mag_size;               /* Capacity of each magazine. */
+    struct list_elem elem;      /* Element in cache_list. */
+
+    /* Slab layer, protected by LOCK. */
+    struct lock lock;           /* Lock. */
+    struct list partial;        /* Slabs with free and in-use objects. */
+    struct slab *spare;         /* A slab with no objects in use, or null. */
+    size_t slab_cnt;            /* Number of slabs. */
+    size_t slab_peak;           /* Maximum of SLAB_CNT. */
+    size_t obj_cnt;             /* Objects not free in the slab layer. */
+
+    /* Magazine layer, accessed only with interrupts off. */
+    struct magazine *loaded;    /* Magazine in use. */
+    struct magazine *previous;  /* Loaded magazine before the last swap. */
+    struct magazine mags[2];    /* Storage for the above. */
+  };
+
+/* Header at the start of each slab. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in cache's partial list. */
+    void *free;                 /* First free object, or null. */
+    size_t in_use;              /* Number of objects not free. */
+  };
+
+/* The cache from which struct kmem_caches are allocated. */
+static struct kmem_cache cache_cache;
+
+/* All caches, protected by cache_list_lock. */
+static struct list cache_list;
+static struct lock cache_list_lock;
+
+static void cache_init (struct kmem_cache *, const char *name,
+                        size_t size, size_t align);
+static void swap_magazines (struct kmem_cache *);
+static void *slab_alloc (struct kmem_cache *);
+static void slab_free (struct kmem_cache *, void **objs, int cnt);
+static struct slab *slab_create (struct kmem_cache *);
+
+/* Initializes the slab allocator. */
+void
+slab_init (void)
+{
+  list_init (&cache_list);
+  lock_init (&cache_list_lock);
+  cache_init (&cache_cache, "kmem_cache", sizeof (struct kmem_cache), 0);
+}
+
+/* Creates and returns a cache of objects of SIZE bytes each,
+   aligned on ALIGN-byte boundaries.  ALIGN must be a power of 2,
+   or 0 for word alignment.  NAME is used only for debugging.
+   Returns a null pointer if memory is not available. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, size_t align)
+{
+  struct kmem_cache *c = kmem_cache_alloc (&cache_cache);
+  if (c != NULL)
+    cache_init (c, name, size, align);
+  return c;
+}
+
+/* Initializes cache C and adds it to cache_list. */
+static void
+cache_init (struct kmem_cache *c, const char *name, size_t size,
+            size_t align)
+{
+  if (align < sizeof (void *))
+    align = sizeof (void *);
+  ASSERT ((align & (align - 1)) == 0);
+  ASSERT (name != NULL);
+
+  memset (c, 0, sizeof *c);
+  strlcpy (c->name, name, sizeof c->name);
+  c->size = ROUND_UP (size > sizeof (void *) ? size : sizeof (void *),
+                      align);
+  c->first_ofs = ROUND_UP (sizeof (struct slab), align);
+  ASSERT (c->first_ofs + c->size <= PGSIZE);
+  c->objs_per_slab = (PGSIZE - c->first_ofs) / c->size;
+
+  /* Don't let the magazines pin down much more than a slab's
+     worth of big objects. */
+  c->mag_size = c->objs_per_slab < MAG_SIZE ? c->objs_per_slab : MAG_SIZE;
+
+  lock_init (&c->lock);
+  list_init (&c->partial);
+  c->loaded = &c->mags[0];
+  c->previous = &c->mags[1];
+
+  lock_acquire (&cache_list_lock);
+  list_push_back (&cache_list, &c->elem);
+  lock_release (&cache_list_lock);
+}
+
+/* Obtains and returns a new object from cache C.  Returns a null
+   pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c)
+{
+  enum intr_level old_level;
+  void *obj = NULL;
+
+  ASSERT (c != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  if (c->loaded->rounds == 0 && c->previous->rounds > 0)
+    swap_magazines (c);
+  if (c->loaded->rounds > 0)
+    obj = c->loaded->objs[--c->loaded->rounds];
+  intr_set_level (old_level);
+
+  if (obj == NULL)
+    obj = slab_alloc (c);
+  return obj;
+}
+
+/* Returns OBJ, which must have been allocated from cache C, to
+   C. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj)
+{
+  void *flush[MAG_SIZE];
+  int flush_cnt = 0;
+  enum intr_level old_level;
+
+  ASSERT (c != NULL);
+  ASSERT (!intr_context ());
+  if (obj == NULL)
+    return;
+  ASSERT (kmem_cache_of (obj) == c);
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs. */
+  memset (obj, 0xcc, c->size);
+#endif
+
+  old_level = intr_disable ();
+  if (c->loaded->rounds >= c->mag_size)
+    {
+      /* Both magazines full?  Empty the previous one into
+         FLUSH, to be given back to the slab layer below. */
+      if (c->previous->rounds >= c->mag_size)
+        {
+          flush_cnt = c->previous->rounds;
+          memcpy (flush, c->previous->objs, flush_cnt * sizeof *flush);
+          c->previous->rounds = 0;
+        }
+      swap_magazines (c);
+    }
+  c->loaded->objs[c->loaded->rounds++] = obj;
+  intr_set_level (old_level);
+
+  if (flush_cnt > 0)
+    slab_free (c, flush, flush_cnt);
+}
+
+/* Returns the size of the objects in cache C. */
+size_t
+kmem_cache_size (const struct kmem_cache *c)
+{
+  return c->size;
+}
+
+/* Returns the cache that OBJ was allocated from, or a null
+   pointer if OBJ is not in a slab. */
+struct kmem_cache *
+kmem_cache_of (const void *obj)
+{
+  const struct slab *s = pg_round_down (obj);
+
+  ASSERT (s != NULL);
+  return s->magic == SLAB_MAGIC ? s->cache : NULL;
+}
+
+/* Prints the usage of each cache that has ever owned a slab. */
+void
+slab_print_stats (void)
+{
+  struct list_elem *e;
+
+  lock_acquire (&cache_list_lock);
+  for (e = list_begin (&cache_list); e != list_end (&cache_list);
+       e = list_next (e))
+    {
+      struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+      enum intr_level old_level;
+      size_t cached;
+
+      if (c->slab_peak == 0)
+        continue;
+      old_level = intr_disable ();
+      cached = c->loaded->rounds + c->previous->rounds;
+      intr_set_level (old_level);
+      printf ("Slab: %s: %zu-byte objects, %zu in use, %zu in "
+              "magazines, %zu pages (peak %zu)\n", c->name, c->size,
+              c->obj_cnt - cached, cached, c->slab_cnt, c->slab_peak);
+    }
+  lock_release (&cache_list_lock);
+}
+
+/* Exchanges C's loaded and previous magazines. */
+static void
+swap_magazines (struct kmem_cache *c)
+{
+  struct magazine *tmp = c->loaded;
+  c->loaded = c->previous;
+  c->previous = tmp;
+}
+
+/* Allocates an object from cache C's slab layer.  Returns a null
+   pointer if memory is not available. */
+static void *
+slab_alloc (struct kmem_cache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  lock_acquire (&c->lock);
+  if (list_empty (&c->partial))
+    {
+      s = c->spare;
+      c->spare = NULL;
+      if (s == NULL)
+        s = slab_create (c);
+      if (s == NULL)
+        {
+          lock_release (&c->lock);
+          return NULL;
+        }
+      list_push_front (&c->partial, &s->elem);
+    }
+
+  s = list_entry (list_front (&c->partial), struct slab, elem);
+  obj = s->free;
+  s->free = *(void **) obj;
+  if (++s->in_use >= c->objs_per_slab)
+    list_remove (&s->elem);
+  c->obj_cnt++;
+  lock_release (&c->lock);
+
+  return obj;
+}
+
+/* Returns the CNT objects in OBJS to cache C's slab layer. */
+static void
+slab_free (struct kmem_cache *c, void **objs, int cnt)
+{
+  int i;
+
+  lock_acquire (&c->lock);
+  for (i = 0; i < cnt; i++)
+    {
+      void *obj = objs[i];
+      struct slab *s = pg_round_down (obj);
+
+      ASSERT (s->magic == SLAB_MAGIC && s->cache == c);
+      ASSERT (s->in_use > 0);
+
+      /* A full slab has free objects again. */
+      if (s->in_use-- >= c->objs_per_slab)
+        list_push_front (&c->partial, &s->elem);
+      *(void **) obj = s->free;
+      s->free = obj;
+      c->obj_cnt--;
+
+      /* Keep one free slab around; give back any others. */
+      if (s->in_use == 0)
+        {
+          list_remove (&s->elem);
+          if (c->spare == NULL)
+            c->spare = s;
+          else
+            {
+              s->magic = 0;
+              palloc_free_page (s);
+              c->slab_cnt--;
+            }
+        }
+    }
+  lock_release (&c->lock);
+}
+
+/* Allocates and returns a new slab for cache C, with all of its
+   objects free, or a null pointer if memory is not available. */
+static struct slab *
+slab_create (struct kmem_cache *c)
+{
+  struct slab *s = palloc_get_page (PAL_SLAB);
+  uint8_t *obj;
+  size_t i;
+
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->in_use = 0;
+  s->free = NULL;
+
+  /* Thread the free list through the objects in reverse, so that
+     they are handed out in address order. */
+  obj = (uint8_t *) s + c->first_ofs + (c->objs_per_slab - 1) * c->size;
+  for (i = 0; i < c->objs_per_slab; i++, obj -= c->size)
+    {
+      *(void **) obj = s->free;
+      s->free = obj;
+    }
+  if (++c->slab_cnt > c->slab_peak)
+    c->slab_peak = c->slab_cnt;
+  return s;
+}
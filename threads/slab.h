@@ -0,0 +1,19 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stddef.h>
+
+/* An object cache: a source of fixed-size objects of one kind.
+   See slab.c for details. */
+struct kmem_cache;
+
+void slab_init (void);
+struct kmem_cache *kmem_cache_create (const char *name, size_t size,
+                                      size_t align);
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+size_t kmem_cache_size (const struct kmem_cache *);
+struct kmem_cache *kmem_cache_of (const void *);
+void slab_print_stats (void);
+
+#endif /* threads/slab.h */
@@ -32,6 +32,14 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
+/* Maximum length of a chain of locks that priority is donated
+   through.  Bounds the work done by lock_acquire() and keeps a
+   deadlock cycle from looping forever. */
+#define DONATION_DEPTH_MAX 8
+
+static void lock_take (struct lock *);
+static void donate_priority (struct lock *);
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -102,7 +110,10 @@ sema_try_down (struct semaphore *sema)
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any, or the one that has waited longest among threads
+   of equal priority.  If the awakened thread has a higher
+   priority than the running thread, the running thread yields.
 
    This function may be called from an interrupt handler. */
 void
@@ -114,10 +125,15 @@ sema_up (struct semaphore *sema)
 
   old_level = intr_disable ();
   if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    {
+      struct list_elem *e = list_max (&sema->waiters,
+                                      thread_priority_less, NULL);
+      list_remove (e);
+      thread_unblock (list_entry (e, struct thread, elem));
+    }
   sema->value++;
   intr_set_level (old_level);
+  thread_preempt ();
 }
 
 static void sema_test_helper (void *sema_);
@@ -178,6 +194,7 @@ lock_init (struct lock *lock)
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
+  lock->max_priority = PRI_MIN;
   sema_init (&lock->semaphore, 1);
 }
 
@@ -185,6 +202,12 @@ lock_init (struct lock *lock)
    necessary.  The lock must not already be held by the current
    thread.
 
+   If the lock is held by a lower-priority thread, the current
+   thread donates its priority to the holder, and on through
+   the chain of locks the holder is itself waiting for, up to
+   DONATION_DEPTH_MAX locks deep.  The MLFQS scheduler does not
+   use priority donation.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -192,12 +215,69 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+  if (lock->holder != NULL && !thread_mlfqs)
+    {
+      cur->wait_lock = lock;
+      donate_priority (lock);
+    }
   sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  cur->wait_lock = NULL;
+  lock_take (lock);
+  intr_set_level (old_level);
+}
+
+/* Makes the current thread the holder of LOCK, whose semaphore
+   it has just downed.  Threads still waiting for LOCK now donate
+   to the current thread.  Interrupts must be off. */
+static void
+lock_take (struct lock *lock)
+{
+  struct thread *cur = thread_current ();
+  struct list *waiters = &lock->semaphore.waiters;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  lock->holder = cur;
+  lock->max_priority = PRI_MIN;
+  if (!list_empty (waiters) && !thread_mlfqs)
+    lock->max_priority = list_entry (list_max (waiters, thread_priority_less,
+                                               NULL),
+                                     struct thread, elem)->priority;
+  list_push_back (&cur->held_locks, &lock->elem);
+  thread_refresh_priority (cur);
+}
+
+/* Donates the current thread's priority to the holder of LOCK,
+   which the current thread is about to wait for, and onward
+   along the chain of locks that each holder is blocked on.
+   Stops early once a lock has already received at least as much
+   priority.  Interrupts must be off. */
+static void
+donate_priority (struct lock *lock)
+{
+  int priority = thread_current ()->priority;
+  int depth;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (depth = 0; lock != NULL && depth < DONATION_DEPTH_MAX; depth++)
+    {
+      struct thread *holder = lock->holder;
+
+      if (holder == NULL || lock->max_priority >= priority)
+        break;
+      lock->max_priority = priority;
+      thread_refresh_priority (holder);
+      lock = holder->wait_lock;
+    }
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -210,17 +290,23 @@ bool
 lock_try_acquire (struct lock *lock)
 {
   bool success;
+  enum intr_level old_level;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    lock_take (lock);
+  intr_set_level (old_level);
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Any priority donated through LOCK is withdrawn, so the current
+   thread's priority falls back to the highest of its base
+   priority and the donations to the other locks it holds.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -228,11 +314,20 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+  list_remove (&lock->elem);
   lock->holder = NULL;
+  lock->max_priority = PRI_MIN;
+  thread_refresh_priority (cur);
   sema_up (&lock->semaphore);
+  intr_set_level (old_level);
+  thread_preempt ();
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -251,8 +346,19 @@ struct semaphore_elem
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
   };
 
+/* Returns true if the thread waiting on semaphore_elem A has a
+   lower priority than the one waiting on B. */
+static bool
+waiter_priority_less (const struct list_elem *a, const struct list_elem *b,
+                      void *aux UNUSED)
+{
+  return (list_entry (a, struct semaphore_elem, elem)->thread->priority
+          < list_entry (b, struct semaphore_elem, elem)->thread->priority);
+}
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -295,6 +401,7 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
   list_push_back (&cond->waiters, &waiter.elem);
   lock_release (lock);
   sema_down (&waiter.semaphore);
@@ -302,8 +409,9 @@ cond_wait (struct condition *cond, struct lock *lock)
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
-   LOCK must be held before calling this function.
+   this function signals the highest-priority one of them to wake
+   up from its wait.  LOCK must be held before calling this
+   function.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
@@ -317,8 +425,12 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (lock_held_by_current_thread (lock));
 
   if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    {
+      struct list_elem *e = list_max (&cond->waiters,
+                                      waiter_priority_less, NULL);
+      list_remove (e);
+      sema_up (&list_entry (e, struct semaphore_elem, elem)->semaphore);
+    }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -4,6 +4,9 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
+#include "threads/cpu.h"
+#include "threads/fixed-point.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
@@ -21,14 +24,28 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Run queues of processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+   There is one FIFO queue per priority level, and bit N of
+   ready_bitmap is set if and only if ready_queues[N] is
+   nonempty, so that enqueueing a thread and finding the
+   highest-priority ready thread both take constant time. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_bitmap;
+static int ready_cnt;           /* Total # of threads in ready_queues. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
+/* All threads, indexed by tid, so that get_thread() and
+   thread_alive() take constant time.  Threads are added once
+   they have a tid and removed in thread_exit().  Protected by
+   tid_table_lock, since the hash table may allocate memory as
+   it grows and shrinks. */
+static struct hash tid_table;
+static struct lock tid_table_lock;
+
 /* Idle thread. */
 static struct thread *idle_thread;
 
@@ -49,7 +66,33 @@ struct kernel_thread_frame
 /* Statistics. */
 static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
-static long long user_ticks;    /* # of timer ticks in user programs. */
+static long long user_ticks;    /* # of timer ticks in user mode. */
+
+/* Scheduling latency: log2 histograms of the time threads wait
+   on the ready queue before they run, in CPU cycles, one
+   histogram per band of LATENCY_BAND_SIZE priorities.  Bucket I
+   counts waits of 2**I to 2**(I+1) - 1 cycles, except that
+   bucket 0 also counts waits of 0 cycles and the last bucket
+   also counts all longer waits.  Updated only with interrupts
+   off. */
+#define LATENCY_BAND_SIZE 16
+#define LATENCY_BANDS ((PRI_MAX + 1) / LATENCY_BAND_SIZE)
+#define LATENCY_BUCKETS 32
+static unsigned latency_hist[LATENCY_BANDS][LATENCY_BUCKETS];
+
+/* Serializes thread_print_sched_stats(). */
+static struct lock sched_stats_lock;
+
+/* Cache of pages freed by dying threads, for reuse by
+   thread_create() without going through the page allocator.
+   The pages form a stack linked through their first word.
+   Accessed only with interrupts off, because dying threads'
+   pages are freed from thread_schedule_tail(). */
+static void *page_cache;        /* Most recently freed page. */
+static size_t page_cache_cnt;   /* # of pages in the cache. */
+size_t thread_page_cache_max = THREAD_PAGE_CACHE_DEFAULT;
+static long long page_cache_hits;   /* # of thread pages reused. */
+static long long page_cache_misses; /* # of thread pages palloc'd. */
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
@@ -60,6 +103,11 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Multi-level feedback queue scheduler. */
+#define NICE_MIN -20            /* Lowest nice value. */
+#define NICE_MAX 20             /* Highest nice value. */
+static fixed_t load_avg;        /* System load average. */
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -67,10 +115,23 @@ static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
+static void ready_enqueue (struct thread *);
+static void ready_remove (struct thread *);
+static int mlfqs_priority (const struct thread *);
+static void mlfqs_update_priority (struct thread *, void *aux);
+static void mlfqs_update_recent_cpu (struct thread *, void *aux);
+static void mlfqs_update_load_avg (void);
+static int ready_max_priority (void);
 static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static struct thread *alloc_thread_page (void);
+static void free_thread_page (struct thread *);
+static hash_hash_func tid_hash;
+static hash_less_func tid_less;
+static void record_ready_wait (struct thread *);
+static void print_latency_hist (void);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -88,10 +149,17 @@ static tid_t allocate_tid (void);
 void
 thread_init (void)
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  lock_init (&sched_stats_lock);
+  for (i = PRI_MIN; i <= PRI_MAX; i++)
+    list_init (&ready_queues[i]);
+  ready_bitmap = 0;
+  ready_cnt = 0;
+  load_avg = 0;
   list_init (&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -106,6 +174,13 @@ thread_init (void)
 void
 thread_start (void)
 {
+  /* Index the threads by tid.  This has to wait until now
+     because the hash table needs malloc(). */
+  lock_init (&tid_table_lock);
+  if (!hash_init (&tid_table, tid_hash, tid_less, NULL))
+    PANIC ("thread_start: out of memory for the tid table");
+  hash_insert (&tid_table, &initial_thread->tidelem);
+
   /* Create the idle thread. */
   struct semaphore idle_started;
   sema_init (&idle_started, 0);
@@ -119,24 +194,52 @@ thread_start (void)
 }
 
 /* Called by the timer interrupt handler at each timer tick.
-   Thus, this function runs in an external interrupt context. */
+   Thus, this function runs in an external interrupt context.
+   USER is true if the tick interrupted user mode. */
 void
-thread_tick (void)
+thread_tick (bool user)
 {
   struct thread *t = thread_current ();
 
   /* Update statistics. */
   if (t == idle_thread)
     idle_ticks++;
-#ifdef USERPROG
-  else if (t->pagedir != NULL)
-    user_ticks++;
-#endif
+  else if (user)
+    {
+      user_ticks++;
+      t->stats.user_ticks++;
+    }
   else
-    kernel_ticks++;
+    {
+      kernel_ticks++;
+      t->stats.kernel_ticks++;
+    }
+
+  /* Update the multi-level feedback queue scheduler.  Only the
+     running thread's recent_cpu changes on an ordinary tick, so
+     only its priority needs recomputing; every thread is visited
+     just once per second, when load_avg and recent_cpu decay. */
+  if (thread_mlfqs)
+    {
+      int64_t now = timer_ticks ();
+
+      if (t != idle_thread)
+        t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+      if (now % TIMER_FREQ == 0)
+        {
+          mlfqs_update_load_avg ();
+          thread_foreach (mlfqs_update_recent_cpu, NULL);
+        }
+      else if (now % TIME_SLICE == 0)
+        mlfqs_update_priority (t, NULL);
+      thread_preempt ();
+    }
 
-  /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  /* Enforce preemption.  The idle thread gives up the CPU on its
+     own as soon as anything else is runnable, and it may account
+     for ticks skipped by dynamic ticks outside interrupt
+     context. */
+  if (t != idle_thread && ++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
 }
 
@@ -146,6 +249,107 @@ thread_print_stats (void)
 {
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  printf ("Thread: %lld page cache hits, %lld misses\n",
+          page_cache_hits, page_cache_misses);
+  print_latency_hist ();
+}
+
+/* Maximum number of threads listed by
+   thread_print_sched_stats(). */
+#define SCHED_STATS_MAX 32
+
+/* Prints the scheduling statistics of each live thread, followed
+   by the scheduling latency histograms. */
+void
+thread_print_sched_stats (void)
+{
+  /* A snapshot of one thread's statistics.  We can't print while
+     walking all_list, because printf() may block on the console
+     lock and let all_list change under us. */
+  static struct
+    {
+      tid_t tid;
+      char name[16];
+      int priority;
+      struct thread_stats stats;
+    }
+  snap[SCHED_STATS_MAX];
+  enum intr_level old_level;
+  struct list_elem *e;
+  int cnt, total, i;
+
+  lock_acquire (&sched_stats_lock);
+
+  cnt = total = 0;
+  old_level = intr_disable ();
+  for (e = list_begin (&all_list); e != list_end (&all_list);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, allelem);
+      if (cnt < SCHED_STATS_MAX)
+        {
+          snap[cnt].tid = t->tid;
+          strlcpy (snap[cnt].name, t->name, sizeof snap[cnt].name);
+          snap[cnt].priority = t->priority;
+          snap[cnt].stats = t->stats;
+          cnt++;
+        }
+      total++;
+    }
+  intr_set_level (old_level);
+
+  printf ("%5s %-15s %3s %8s %8s %6s %6s %14s %12s\n",
+          "TID", "NAME", "PRI", "USER", "KERNEL", "VOL", "INVOL",
+          "READY-CYCLES", "MAX-CYCLES");
+  for (i = 0; i < cnt; i++)
+    {
+      const struct thread_stats *s = &snap[i].stats;
+      printf ("%5d %-15s %3d %8lld %8lld %6u %6u %14llu %12llu\n",
+              snap[i].tid, snap[i].name, snap[i].priority,
+              s->user_ticks, s->kernel_ticks,
+              s->vol_switches, s->invol_switches,
+              (unsigned long long) s->ready_total,
+              (unsigned long long) s->ready_max);
+    }
+  if (total > cnt)
+    printf ("(%d more threads not shown)\n", total - cnt);
+  print_latency_hist ();
+
+  lock_release (&sched_stats_lock);
+}
+
+/* Prints the scheduling latency histogram of each priority band
+   in which any thread has been scheduled. */
+static void
+print_latency_hist (void)
+{
+  static unsigned hist[LATENCY_BANDS][LATENCY_BUCKETS];
+  enum intr_level old_level;
+  int band, i;
+
+  old_level = intr_disable ();
+  memcpy (hist, latency_hist, sizeof hist);
+  intr_set_level (old_level);
+
+  for (band = 0; band < LATENCY_BANDS; band++)
+    {
+      unsigned long long cnt = 0;
+
+      for (i = 0; i < LATENCY_BUCKETS; i++)
+        cnt += hist[band][i];
+      if (cnt == 0)
+        continue;
+
+      printf ("Thread: priority %d-%d ready latency, %llu samples:\n",
+              band * LATENCY_BAND_SIZE,
+              (band + 1) * LATENCY_BAND_SIZE - 1, cnt);
+      for (i = 0; i < LATENCY_BUCKETS; i++)
+        if (hist[band][i] != 0)
+          printf ("Thread:   %s2^%d cycles: %u\n",
+                  i == LATENCY_BUCKETS - 1 ? ">= " : "< ",
+                  i == LATENCY_BUCKETS - 1 ? i : i + 1,
+                  hist[band][i]);
+    }
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -160,9 +364,9 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If PRIORITY is higher than the running thread's priority, the
+   new thread preempts the caller before thread_create()
+   returns. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux)
@@ -177,13 +381,16 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = alloc_thread_page ();
   if (t == NULL)
     return TID_ERROR;
 
   /* Initialize thread. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
+  lock_acquire (&tid_table_lock);
+  hash_insert (&tid_table, &t->tidelem);
+  lock_release (&tid_table_lock);
 
   /* Prepare thread for first run by initializing its stack.
      Do this atomically so intermediate values for the 'stack'
@@ -237,10 +444,13 @@ thread_block (void)
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
 
-   This function does not preempt the running thread.  This can
-   be important: if the caller had disabled interrupts itself,
-   it may expect that it can atomically unblock a thread and
-   update other data. */
+   If T has a higher priority than the running thread, the
+   running thread is preempted, but only if the caller had
+   interrupts enabled.  This can be important: if the caller had
+   disabled interrupts itself, it may expect that it can
+   atomically unblock a thread and update other data, so it must
+   call thread_preempt() itself once it turns interrupts back
+   on. */
 void
 thread_unblock (struct thread *t)
 {
@@ -250,9 +460,31 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  ready_enqueue (t);
   t->status = THREAD_READY;
+  t->stats.ready_since = cpu_read_tsc ();
   intr_set_level (old_level);
+
+  if (old_level == INTR_ON)
+    thread_preempt ();
+}
+
+/* Yields the CPU if a ready thread has a higher priority than
+   the running thread.  In an interrupt handler, the yield is
+   deferred until the handler returns.  Does nothing if
+   interrupts are disabled, since the caller may be relying on
+   them being off. */
+void
+thread_preempt (void)
+{
+  if (intr_context ())
+    {
+      if (ready_max_priority () > thread_current ()->priority)
+        intr_yield_on_return ();
+    }
+  else if (intr_get_level () == INTR_ON
+           && ready_max_priority () > thread_current ()->priority)
+    thread_yield ();
 }
 
 /* Returns the name of the running thread. */
@@ -299,6 +531,10 @@ thread_exit (void)
   process_exit ();
 #endif
 
+  lock_acquire (&tid_table_lock);
+  hash_delete (&tid_table, &thread_current ()->tidelem);
+  lock_release (&tid_table_lock);
+
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
@@ -321,7 +557,10 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread)
-    list_push_back (&ready_list, &cur->elem);
+    {
+      ready_enqueue (cur);
+      cur->stats.ready_since = cpu_read_tsc ();
+    }
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
@@ -343,28 +582,92 @@ thread_foreach (thread_action_func *func, void *aux)
       func (t, aux);
     }
 }
-struct thread*
-get_thread(tid_t tid){
-  struct list_elem *e;
 
-  for (e = list_begin (&all_list); e != list_end (&all_list);
-       e = list_next (e)){
-    struct thread *t = list_entry (e, struct thread, allelem);
-    if(tid == t->tid){
-      return t;
-    }
-  }
+/* Returns the live thread with the given TID, or a null pointer
+   if there is none. */
+struct thread *
+get_thread (tid_t tid)
+{
+  struct thread key;
+  struct hash_elem *e;
+
+  key.tid = tid;
+  lock_acquire (&tid_table_lock);
+  e = hash_find (&tid_table, &key.tidelem);
+  lock_release (&tid_table_lock);
+
+  return e != NULL ? hash_entry (e, struct thread, tidelem) : NULL;
 }
+
+
 struct thread* get_idle_thread(){
   return idle_thread;
 }
 
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's base priority to NEW_PRIORITY.
+   Priority donated through locks the thread holds still applies
+   on top of it.  Yields if some ready thread now has a higher
+   priority. */
 void
 thread_set_priority (int new_priority)
 {
-  thread_current ()->priority = new_priority;
+  enum intr_level old_level;
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  /* The MLFQS scheduler computes priorities itself. */
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  thread_current ()->base_priority = new_priority;
+  thread_refresh_priority (thread_current ());
+  intr_set_level (old_level);
+  thread_preempt ();
+}
+
+/* Recomputes T's effective priority as the maximum of its base
+   priority and the priorities donated to the locks it holds.
+   If T is on a run queue, moves it to the queue for its new
+   priority.  Interrupts must be off. */
+void
+thread_refresh_priority (struct thread *t)
+{
+  int priority = t->base_priority;
+  struct list_elem *e;
+
+  ASSERT (is_thread (t));
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&t->held_locks); e != list_end (&t->held_locks);
+       e = list_next (e))
+    {
+      struct lock *lock = list_entry (e, struct lock, elem);
+      if (lock->max_priority > priority)
+        priority = lock->max_priority;
+    }
+
+  if (priority == t->priority)
+    return;
+  if (t->status == THREAD_READY)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_enqueue (t);
+    }
+  else
+    t->priority = priority;
+}
+
+/* Returns true if the thread that owns list element A has a
+   lower priority than the one that owns B. */
+bool
+thread_priority_less (const struct list_elem *a, const struct list_elem *b,
+                      void *aux UNUSED)
+{
+  return (list_entry (a, struct thread, elem)->priority
+          < list_entry (b, struct thread, elem)->priority);
 }
 
 /* Returns the current thread's priority. */
@@ -374,35 +677,125 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes
+   its priority, yielding if it no longer has the highest
+   priority. */
 void
-thread_set_nice (int nice UNUSED)
+thread_set_nice (int nice)
 {
-  /* Not yet implemented. */
+  enum intr_level old_level;
+
+  if (nice < NICE_MIN)
+    nice = NICE_MIN;
+  else if (nice > NICE_MAX)
+    nice = NICE_MAX;
+
+  old_level = intr_disable ();
+  thread_current ()->nice = nice;
+  if (thread_mlfqs)
+    mlfqs_update_priority (thread_current (), NULL);
+  intr_set_level (old_level);
+  thread_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load = fp_round (fp_mul_int (load_avg, 100));
+  intr_set_level (old_level);
+  return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu = fp_round (fp_mul_int (thread_current ()->recent_cpu, 100));
+  intr_set_level (old_level);
+  return recent_cpu;
+}
+
+/* Returns T's MLFQS priority computed from its recent_cpu and
+   nice values:
+
+       priority = PRI_MAX - (recent_cpu / 4) - (nice * 2)
+
+   clamped to PRI_MIN...PRI_MAX. */
+static int
+mlfqs_priority (const struct thread *t)
+{
+  int priority = (PRI_MAX - fp_trunc (fp_div_int (t->recent_cpu, 4))
+                  - t->nice * 2);
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  return priority;
+}
+
+/* Recomputes T's MLFQS priority, moving it to a different run
+   queue if necessary.  Interrupts must be off. */
+static void
+mlfqs_update_priority (struct thread *t, void *aux UNUSED)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t == idle_thread)
+    return;
+
+  t->base_priority = mlfqs_priority (t);
+  thread_refresh_priority (t);
+}
+
+/* Decays T's recent_cpu by the load average and then recomputes
+   its priority:
+
+       recent_cpu = (2*load_avg)/(2*load_avg + 1) * recent_cpu + nice
+
+   Interrupts must be off. */
+static void
+mlfqs_update_recent_cpu (struct thread *t, void *aux UNUSED)
+{
+  fixed_t twice_load = fp_mul_int (load_avg, 2);
+
+  if (t == idle_thread)
+    return;
+
+  t->recent_cpu = fp_add_int (fp_mul (fp_div (twice_load,
+                                               fp_add_int (twice_load, 1)),
+                                      t->recent_cpu),
+                              t->nice);
+  mlfqs_update_priority (t, NULL);
+}
+
+/* Updates the system load average from the number of threads
+   that are running or ready to run:
+
+       load_avg = (59/60)*load_avg + (1/60)*ready_threads
+
+   Interrupts must be off. */
+static void
+mlfqs_update_load_avg (void)
+{
+  int ready_threads = ready_cnt;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_current () != idle_thread)
+    ready_threads++;
+  load_avg = fp_add (fp_mul (fp_div_int (fp_from_int (59), 60), load_avg),
+                     fp_mul_int (fp_div_int (fp_from_int (1), 60),
+                                 ready_threads));
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -427,6 +820,20 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Nothing is runnable.  Put the time to use zeroing free
+         pages for later PAL_ZERO allocations, until there are
+         enough of them or something becomes runnable. */
+      intr_enable ();
+      while (ready_cnt == 0 && palloc_zero_idle ())
+        continue;
+      intr_disable ();
+      if (ready_cnt != 0)
+        continue;
+
+      /* Stop the periodic tick until the next timer deadline, if
+         dynamic ticks are enabled. */
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -489,6 +896,16 @@ init_thread (struct thread *t, const char *name, int priority)
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
   t->priority = priority;
+  t->base_priority = priority;
+  list_init (&t->held_locks);
+  if (t != initial_thread)
+    {
+      /* New threads inherit their creator's nice and recent_cpu. */
+      t->nice = thread_current ()->nice;
+      t->recent_cpu = thread_current ()->recent_cpu;
+      if (thread_mlfqs)
+        t->base_priority = t->priority = mlfqs_priority (t);
+    }
   t->magic = THREAD_MAGIC;
   list_push_back (&all_list, &t->allelem);
 
@@ -496,6 +913,9 @@ init_thread (struct thread *t, const char *name, int priority)
   t->fd = 2;              // 우선 Standard Error로 초기화. 새로운 파일 오픈을 하거나 소켓 생성 시 + 1을 통해 일반적인 값으로 바꿈.
 
   list_init(&t->child_list);
+#ifdef VM
+  list_init (&t->mappings);
+#endif
   t->cp = NULL;
   t->parent = -1;
 }
@@ -513,18 +933,114 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
+/* Returns the index of the most significant set bit in X,
+   which must be nonzero. */
+static inline int
+bit_scan_reverse (uint32_t x)
+{
+  int idx;
+
+  ASSERT (x != 0);
+  asm ("bsrl %1, %0" : "=r" (idx) : "rm" (x));
+  return idx;
+}
+
+/* Adds T to the tail of the run queue for its priority.
+   Interrupts must be off. */
+static void
+ready_enqueue (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_bitmap |= (uint64_t) 1 << t->priority;
+  ready_cnt++;
+}
+
+/* Removes ready thread T from its run queue.  Interrupts must
+   be off. */
+static void
+ready_remove (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[t->priority]))
+    ready_bitmap &= ~((uint64_t) 1 << t->priority);
+  ready_cnt--;
+}
+
+/* Returns the priority of the highest-priority ready thread, or
+   -1 if no thread is ready. */
+static int
+ready_max_priority (void)
+{
+  uint32_t high = ready_bitmap >> 32;
+  uint32_t low = ready_bitmap;
+
+  if (high != 0)
+    return 32 + bit_scan_reverse (high);
+  else if (low != 0)
+    return bit_scan_reverse (low);
+  else
+    return -1;
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   idle_thread.
+
+   Takes the thread at the head of the highest-priority nonempty
+   queue, so that threads of equal priority run round-robin. */
 static struct thread *
 next_thread_to_run (void)
 {
-  if (list_empty (&ready_list))
+  int priority = ready_max_priority ();
+  struct list *queue;
+  struct thread *t;
+
+  if (priority < 0)
     return idle_thread;
+
+  queue = &ready_queues[priority];
+  t = list_entry (list_pop_front (queue), struct thread, elem);
+  if (list_empty (queue))
+    ready_bitmap &= ~((uint64_t) 1 << priority);
+  ready_cnt--;
+  return t;
+}
+
+/* Charges T, which is about to run, for the time it spent on the
+   ready queue, if any. */
+static void
+record_ready_wait (struct thread *t)
+{
+  uint64_t wait;
+  int band, bucket;
+
+  if (t->stats.ready_since == 0 || t == idle_thread)
+    return;
+
+  wait = cpu_read_tsc () - t->stats.ready_since;
+  t->stats.ready_since = 0;
+  t->stats.ready_total += wait;
+  if (wait > t->stats.ready_max)
+    t->stats.ready_max = wait;
+
+  if (wait >> 32 != 0)
+    bucket = 32 + bit_scan_reverse (wait >> 32);
+  else if (wait != 0)
+    bucket = bit_scan_reverse (wait);
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    bucket = 0;
+  if (bucket >= LATENCY_BUCKETS)
+    bucket = LATENCY_BUCKETS - 1;
+  band = t->priority / LATENCY_BAND_SIZE;
+  latency_hist[band][bucket]++;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -555,6 +1071,7 @@ thread_schedule_tail (struct thread *prev)
 
   /* Start new time slice. */
   thread_ticks = 0;
+  record_ready_wait (cur);
 
 #ifdef USERPROG
   /* Activate the new address space. */
@@ -569,7 +1086,7 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread)
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      free_thread_page (prev);
     }
 }
 
@@ -591,11 +1108,76 @@ schedule (void)
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  /* If the idle thread was woken early from a tickless halt,
+     restart the periodic tick before anything else runs.  This
+     is the one place that sees every way out of the idle loop,
+     including preemption on return from an interrupt. */
+  if (cur == idle_thread)
+    timer_idle_exit ();
+
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      /* As in other Unix-like kernels, a thread that yields counts
+         as involuntarily switched out, since it remains
+         runnable. */
+      if (cur->status == THREAD_BLOCKED)
+        cur->stats.vol_switches++;
+      else if (cur->status == THREAD_READY)
+        cur->stats.invol_switches++;
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
+/* Returns a page for a new thread's struct thread and kernel
+   stack, preferably one recycled from a dead thread, or a null
+   pointer if memory is exhausted.  The page's contents are
+   arbitrary: init_thread() initializes the struct thread, and
+   the stack needs no initialization. */
+static struct thread *
+alloc_thread_page (void)
+{
+  enum intr_level old_level;
+  void *page;
+
+  old_level = intr_disable ();
+  page = page_cache;
+  if (page != NULL)
+    {
+      page_cache = *(void **) page;
+      page_cache_cnt--;
+      page_cache_hits++;
+    }
+  else
+    page_cache_misses++;
+  intr_set_level (old_level);
+
+  if (page == NULL)
+    page = palloc_get_page (PAL_STACK);
+  return page;
+}
+
+/* Releases dead thread T's page, keeping it for reuse unless the
+   cache already holds thread_page_cache_max pages.  Interrupts
+   must be off. */
+static void
+free_thread_page (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Make sure a stale pointer to T fails is_thread(). */
+  t->magic = 0;
+
+  if (page_cache_cnt < thread_page_cache_max)
+    {
+      *(void **) t = page_cache;
+      page_cache = t;
+      page_cache_cnt++;
+    }
+  else
+    palloc_free_page (t);
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t
 allocate_tid (void)
@@ -614,16 +1196,26 @@ allocate_tid (void)
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof (struct thread, stack);
 
-bool thread_alive (int pid)
+/* Returns true if a thread with tid PID has not yet exited. */
+bool
+thread_alive (int pid)
 {
-  struct list_elem *e;
+  return get_thread (pid) != NULL;
+}
 
-  for (e = list_begin (&all_list); e != list_end (&all_list);
-       e = list_next (e)){
-      struct thread *t = list_entry (e, struct thread, allelem);
-      if (t->tid == pid){
-	       return true;
-	      }
-    }
-  return false;
+/* Returns a hash value for the thread that owns hash element E. */
+static unsigned
+tid_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct thread, tidelem)->tid);
+}
+
+/* Returns true if the thread that owns A has a smaller tid than
+   the one that owns B. */
+static bool
+tid_less (const struct hash_elem *a, const struct hash_elem *b,
+          void *aux UNUSED)
+{
+  return (hash_entry (a, struct thread, tidelem)->tid
+          < hash_entry (b, struct thread, tidelem)->tid);
 }
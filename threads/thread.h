@@ -2,8 +2,10 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <stdint.h>
+#include "threads/fixed-point.h"
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -28,6 +30,34 @@ typedef int tid_t;
 #define load_fail 0
 #define load_unloaded -1
 
+/* Per-thread scheduling statistics.  Times spent on the ready
+   queue are in CPU cycles, as counted by the time-stamp
+   counter. */
+struct thread_stats
+  {
+    int64_t user_ticks;                 /* Timer ticks in user mode. */
+    int64_t kernel_ticks;               /* Timer ticks in kernel mode. */
+    unsigned vol_switches;              /* Switched out by blocking. */
+    unsigned invol_switches;            /* Switched out while runnable. */
+    uint64_t ready_since;               /* TSC when made ready, or 0. */
+    uint64_t ready_total;               /* Total cycles on ready queue. */
+    uint64_t ready_max;                 /* Longest single ready wait. */
+  };
+
+#ifdef USERPROG
+/* Most ranges of user pages that one system call pins: the page
+   that holds its number, and a string or buffer argument. */
+#define PIN_MAX 2
+
+/* A range of user pages that a system call has pinned.  See
+   userprog/syscall.c. */
+struct pin_range
+  {
+    const uint8_t *upage;               /* First page. */
+    size_t page_cnt;                    /* Number of pages pinned. */
+  };
+#endif
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -78,12 +108,14 @@ typedef int tid_t;
    the `magic' member of the running thread's `struct thread' is
    set to THREAD_MAGIC.  Stack overflow will normally change this
    value, triggering the assertion. */
-/* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+/* The `elem' member has a triple purpose.  It can be an element
+   in the run queue (thread.c), an element in a semaphore wait
+   list (synch.c), or an element in the sleep list (timer.c).  It
+   can be used these ways only because they are mutually
+   exclusive: only a thread in the ready state is on the run
+   queue, whereas only a thread in the blocked state is on a
+   semaphore wait list or the sleep list, and a thread blocks on
+   only one of those at a time. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -91,11 +123,25 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Effective priority. */
     struct list_elem allelem;           /* List element for all threads list. */
+    struct hash_elem tidelem;           /* Element in tid table. */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
+    int base_priority;                  /* Priority before donation. */
+    struct lock *wait_lock;             /* Lock being waited for, if any. */
+    struct list held_locks;             /* Locks currently held. */
+
+    /* Owned by thread.c, for the MLFQS scheduler. */
+    int nice;                           /* Niceness. */
+    fixed_t recent_cpu;                 /* Recent CPU time received. */
+
+    /* Owned by devices/timer.c. */
+    int64_t wakeup_tick;                /* Tick to wake up at when asleep. */
+
+    /* Owned by thread.c. */
+    struct thread_stats stats;          /* Scheduling statistics. */
 
     tid_t parent;
     struct thread *child;
@@ -116,12 +162,33 @@ struct thread
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+
+    /* Owned by userprog/syscall.c.  User pages that the running
+       system call uses, which stay in memory and in place until
+       it returns. */
+    struct pin_range pins[PIN_MAX];     /* Pinned ranges. */
+    int pin_cnt;                        /* Number of ranges in PINS. */
+
+#ifdef VM
+    /* Owned by vm/page.c. */
+    struct hash pages;                  /* Supplemental page table. */
+
+    /* Owned by userprog/syscall.c. */
+    struct list mappings;               /* Memory-mapped files. */
+    int next_mapid;                     /* Identifier for next mmap(). */
+#endif
 #endif
 
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
   };
 
+/* Maximum number of dead threads' pages kept for reuse by
+   thread_create().  Controlled by kernel command-line option
+   "-tcache". */
+#define THREAD_PAGE_CACHE_DEFAULT 16
+extern size_t thread_page_cache_max;
+
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
@@ -133,14 +200,19 @@ void thread_start (void);
 struct thread* get_thread(tid_t tid);
 struct thread* get_idle_thread();
 
-void thread_tick (void);
+void thread_tick (bool user);
 void thread_print_stats (void);
+void thread_print_sched_stats (void);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
 
 void thread_block (void);
 void thread_unblock (struct thread *);
+void thread_preempt (void);
+void thread_refresh_priority (struct thread *);
+bool thread_priority_less (const struct list_elem *,
+                           const struct list_elem *, void *aux);
 
 struct thread *thread_current (void);
 tid_t thread_tid (void);
@@ -52,6 +52,13 @@ static inline void *pg_round_down (const void *va) {
    virtual address space belongs to the kernel. */
 #define	PHYS_BASE ((void *) LOADER_PHYS_BASE)
 
+/* Kernel virtual addresses from VMALLOC_START up to VMALLOC_END
+   are not part of the mapping of physical memory, which ends at
+   PHYS_BASE + LOADER_RAM_MAX at most.  vmalloc() maps pages there
+   on demand; see vmalloc.c. */
+#define VMALLOC_START ((void *) 0xf8000000)
+#define VMALLOC_END ((void *) 0xffc00000)
+
 /* Returns true if VADDR is a user virtual address. */
 static inline bool
 is_user_vaddr (const void *vaddr) 
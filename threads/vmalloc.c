@@ -0,0 +1,201 @@
+#include "threads/vmalloc.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/init.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Allocator for large kernel buffers that need not be physically
+   contiguous.
+
+   vmalloc() gets the pages for a buffer one at a time from the
+   page allocator, wherever they happen to be, and maps them at
+   consecutive addresses in a region of kernel virtual memory set
+   aside for the purpose, from VMALLOC_START to VMALLOC_END,
+   above the mapping of physical memory.  So a big buffer can be
+   had whenever enough pages are free, however fragmented they
+   are.  The price is that its pages have no kernel virtual
+   addresses of their own besides the ones in the region, so
+   vtop() does not work on them.
+
+   The page tables for the whole region are created and installed
+   in init_page_dir by vmalloc_init(), before any process's page
+   directory is created.  pagedir_create() copies the kernel's
+   page directory entries, so every page directory shares the
+   same page tables, and a mapping added or removed in the region
+   takes effect in all of them at once.  Removing a mapping still
+   requires flushing it from the TLB with "invlpg".
+
+   Each buffer is followed by an unmapped guard page, which turns
+   an overrun into a page fault and tells vfree() where the
+   buffer ends. */
+
+/* Number of pages in the vmalloc region. */
+#define REGION_PAGES \
+        (((uintptr_t) VMALLOC_END - (uintptr_t) VMALLOC_START) / PGSIZE)
+
+/* Protects the members below. */
+static struct lock vmalloc_lock;
+
+/* Pages of the region that are in use, including guard pages. */
+static struct bitmap *region_map;
+
+/* Statistics. */
+static size_t mapped_cnt;               /* Pages now mapped. */
+static size_t mapped_peak;              /* Maximum of MAPPED_CNT. */
+static size_t buffer_cnt;               /* Buffers now allocated. */
+static long long vmalloc_cnt;           /* Number of vmalloc() calls. */
+static long long vmalloc_failures;      /* Calls that returned null. */
+
+static uint32_t *region_pte (const void *vaddr);
+static void unmap_pages (uint8_t *vaddr, size_t page_cnt);
+
+/* Creates the page tables for the vmalloc region.  Must be
+   called after paging_init() and before any page directory other
+   than init_page_dir is created. */
+void
+vmalloc_init (void)
+{
+  uint8_t *vaddr;
+
+  lock_init (&vmalloc_lock);
+  region_map = bitmap_create (REGION_PAGES);
+  if (region_map == NULL)
+    PANIC ("out of memory creating vmalloc region map");
+
+  for (vaddr = VMALLOC_START; vaddr < (uint8_t *) VMALLOC_END;
+       vaddr += PTSPAN)
+    {
+      uint32_t *pt = palloc_get_page (PAL_ASSERT | PAL_ZERO
+                                      | PAL_PAGETABLE);
+      ASSERT (init_page_dir[pd_no (vaddr)] == 0);
+      init_page_dir[pd_no (vaddr)] = pde_create (pt);
+    }
+}
+
+/* Obtains and returns a new buffer of at least SIZE bytes,
+   page-aligned and backed by pages that need not be physically
+   contiguous.  Returns a null pointer if SIZE is 0 or if memory
+   or address space is not available.  May sleep, so it must not
+   be called from an interrupt handler. */
+void *
+vmalloc (size_t size)
+{
+  size_t page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  size_t start = BITMAP_ERROR;
+  uint8_t *vaddr;
+  size_t i;
+
+  /* Reserve PAGE_CNT pages of address space plus a guard page. */
+  lock_acquire (&vmalloc_lock);
+  vmalloc_cnt++;
+  if (page_cnt > 0 && page_cnt < REGION_PAGES)
+    start = bitmap_scan_and_flip (region_map, 0, page_cnt + 1, false);
+  if (start == BITMAP_ERROR)
+    vmalloc_failures++;
+  lock_release (&vmalloc_lock);
+  if (start == BITMAP_ERROR)
+    return NULL;
+
+  /* Back the address space with pages. */
+  vaddr = (uint8_t *) VMALLOC_START + PGSIZE * start;
+  for (i = 0; i < page_cnt; i++)
+    {
+      void *page = palloc_get_page (PAL_VMALLOC);
+      if (page == NULL)
+        {
+          unmap_pages (vaddr, i);
+          lock_acquire (&vmalloc_lock);
+          bitmap_set_multiple (region_map, start, page_cnt + 1, false);
+          vmalloc_failures++;
+          lock_release (&vmalloc_lock);
+          return NULL;
+        }
+      *region_pte (vaddr + PGSIZE * i) = pte_create_kernel (page, true);
+    }
+
+  lock_acquire (&vmalloc_lock);
+  mapped_cnt += page_cnt;
+  if (mapped_cnt > mapped_peak)
+    mapped_peak = mapped_cnt;
+  buffer_cnt++;
+  lock_release (&vmalloc_lock);
+
+  return vaddr;
+}
+
+/* Frees buffer P, which must have been returned by vmalloc().
+   If P is a null pointer, does nothing. */
+void
+vfree (void *p)
+{
+  uint8_t *vaddr = p;
+  size_t page_cnt = 0;
+
+  if (p == NULL)
+    return;
+  ASSERT (is_vmalloc_addr (p));
+  ASSERT (pg_ofs (p) == 0);
+
+  /* The buffer ends at its unmapped guard page. */
+  while (*region_pte (vaddr + PGSIZE * page_cnt) & PTE_P)
+    page_cnt++;
+  ASSERT (page_cnt > 0);
+  unmap_pages (vaddr, page_cnt);
+
+  lock_acquire (&vmalloc_lock);
+  bitmap_set_multiple (region_map, pg_no (vaddr) - pg_no (VMALLOC_START),
+                       page_cnt + 1, false);
+  mapped_cnt -= page_cnt;
+  buffer_cnt--;
+  lock_release (&vmalloc_lock);
+}
+
+/* Returns true if VADDR lies in the vmalloc region. */
+bool
+is_vmalloc_addr (const void *vaddr)
+{
+  return vaddr >= VMALLOC_START && vaddr < VMALLOC_END;
+}
+
+/* Prints vmalloc statistics. */
+void
+vmalloc_print_stats (void)
+{
+  printf ("Vmalloc: %zu pages in %zu buffers (peak %zu pages), "
+          "%lld calls, %lld failed\n",
+          mapped_cnt, buffer_cnt, mapped_peak, vmalloc_cnt,
+          vmalloc_failures);
+}
+
+/* Returns the page table entry for VADDR, which must lie in the
+   vmalloc region. */
+static uint32_t *
+region_pte (const void *vaddr)
+{
+  ASSERT (is_vmalloc_addr (vaddr));
+  return &pde_get_pt (init_page_dir[pd_no (vaddr)])[pt_no (vaddr)];
+}
+
+/* Unmaps the PAGE_CNT pages starting at VADDR in the vmalloc
+   region, flushes them from the TLB, and frees them. */
+static void
+unmap_pages (uint8_t *vaddr, size_t page_cnt)
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++, vaddr += PGSIZE)
+    {
+      uint32_t *pte = region_pte (vaddr);
+      void *page = pte_get_page (*pte);
+
+      *pte = 0;
+      asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+      palloc_free_page (page);
+    }
+}
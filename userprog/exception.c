@@ -4,6 +4,10 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 #include "userprog/syscall.h"
 
@@ -150,9 +154,21 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
-  /* To implement virtual memory, delete the rest of the function
-     body, and replace it with code that brings in the page to
-     which fault_addr refers. */
+#ifdef VM
+  /* Bring in a page of the process that is not in memory yet.
+     The kernel faults on user pages too when a system call
+     touches them. */
+  if (not_present && is_user_vaddr (fault_addr)
+      && thread_current ()->pagedir != NULL && page_load (fault_addr))
+    return;
+
+  /* Copy a page that the process shares with its parent or a
+     child after fork() when it first writes to it. */
+  if (!not_present && write && is_user_vaddr (fault_addr)
+      && thread_current ()->pagedir != NULL && page_unshare (fault_addr))
+    return;
+#endif
+
   printf ("Page fault at %p: %s error %s page in %s context.\n",
           fault_addr,
           not_present ? "not present" : "rights violation",
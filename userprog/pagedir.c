@@ -3,11 +3,13 @@
 #include <stddef.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 
 static uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
+static bool remap_frame (uint32_t *pd, void *kpage, void *new_kpage);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -16,7 +18,7 @@ static void invalidate_pagedir (uint32_t *);
 uint32_t *
 pagedir_create (void) 
 {
-  uint32_t *pd = palloc_get_page (0);
+  uint32_t *pd = palloc_get_page (PAL_PAGETABLE);
   if (pd != NULL)
     memcpy (pd, init_page_dir, PGSIZE);
   return pd;
@@ -70,7 +72,7 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
     {
       if (create)
         {
-          pt = palloc_get_page (PAL_ZERO);
+          pt = palloc_get_page (PAL_ZERO | PAL_PAGETABLE);
           if (pt == NULL) 
             return NULL; 
       
@@ -136,6 +138,48 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
     return NULL;
 }
 
+/* Makes every user virtual page that PD maps to the frame at
+   kernel virtual address KPAGE map to the frame at NEW_KPAGE
+   instead, keeping the other bits in their page table entries.
+   Returns true if PD mapped any page to KPAGE, false
+   otherwise.
+   The caller is responsible for copying the frame's contents,
+   with interrupts off so that no process can modify it in
+   between. */
+bool
+pagedir_remap_frame (uint32_t *pd, void *kpage, void *new_kpage)
+{
+  ASSERT (new_kpage != NULL);
+  ASSERT (pg_ofs (new_kpage) == 0);
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!remap_frame (pd, kpage, new_kpage))
+    return false;
+  invalidate_pagedir (pd);
+  return true;
+}
+
+/* Makes user virtual page UPAGE, which PD must map, map to the
+   frame at kernel virtual address NEW_KPAGE instead, keeping the
+   other bits in its page table entry.
+   The caller is responsible for copying the frame's contents,
+   with interrupts off so that no process can modify it in
+   between. */
+void
+pagedir_move_page (uint32_t *pd, const void *upage, void *new_kpage)
+{
+  uint32_t *pte;
+
+  ASSERT (new_kpage != NULL);
+  ASSERT (pg_ofs (new_kpage) == 0);
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  pte = lookup_page (pd, upage, false);
+  ASSERT (pte != NULL && (*pte & PTE_P) != 0);
+  *pte = (*pte & PTE_FLAGS) | vtop (new_kpage);
+  invalidate_pagedir (pd);
+}
+
 /* Marks user virtual page UPAGE "not present" in page
    directory PD.  Later accesses to the page will fault.  Other
    bits in the page table entry are preserved.
@@ -156,6 +200,31 @@ pagedir_clear_page (uint32_t *pd, void *upage)
     }
 }
 
+/* Returns true if PD maps virtual page VPAGE writable.
+   Returns false if PD contains no PTE for VPAGE. */
+bool
+pagedir_is_writable (uint32_t *pd, const void *vpage) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  return pte != NULL && (*pte & PTE_P) != 0 && (*pte & PTE_W) != 0;
+}
+
+/* Sets the writable bit to WRITABLE in the PTE for virtual page
+   VPAGE in PD. */
+void
+pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  if (pte != NULL) 
+    {
+      if (writable)
+        *pte |= PTE_W;
+      else
+        *pte &= ~(uint32_t) PTE_W;
+      invalidate_pagedir (pd);
+    }
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
    that is, if the page has been modified since the PTE was
    installed.
@@ -226,10 +295,39 @@ pagedir_activate (uint32_t *pd)
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base
-     Address of the Page Directory". */
+     Address of the Page Directory".  Kernel mappings are global
+     (see paging_init()), so this flushes only user translations
+     from the TLB. */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
 }
 
+/* Searches PD's user page tables for entries that map the frame
+   at kernel virtual address KPAGE and points them to NEW_KPAGE
+   instead.  Returns true if any entry mapped KPAGE. */
+static bool
+remap_frame (uint32_t *pd, void *kpage, void *new_kpage)
+{
+  uint32_t *pde;
+  bool found = false;
+
+  ASSERT (pg_ofs (kpage) == 0);
+
+  for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
+    if (*pde & PTE_P)
+      {
+        uint32_t *pt = pde_get_pt (*pde);
+        uint32_t *pte;
+
+        for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
+          if ((*pte & PTE_P) && pte_get_page (*pte) == kpage)
+            {
+              found = true;
+              *pte = (*pte & PTE_FLAGS) | vtop (new_kpage);
+            }
+      }
+  return found;
+}
+
 /* Returns the currently active page directory. */
 static uint32_t *
 active_pd (void) 
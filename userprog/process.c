@@ -19,8 +19,15 @@
 #include "threads/vaddr.h"
 #include "threads/synch.h"
 #include "userprog/syscall.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 static thread_func start_process NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
+#ifdef VM
+static thread_func start_fork NO_RETURN;
+static bool copy_process (struct thread *parent);
+#endif
 
 #define LOAD_SUCCESS 1
 #define LOAD_FAIL 0
@@ -38,7 +45,7 @@ process_execute (const char *file_name)
 
   /* Make a copy of FILE_NAME.
      Otherwise there's a race between the caller and load(). */
-  fn_copy = palloc_get_page (0);
+  fn_copy = palloc_get_page (PAL_BUFFER);
   if (fn_copy == NULL)
     return TID_ERROR;
   strlcpy (fn_copy, file_name, PGSIZE);
@@ -102,6 +109,104 @@ start_process (void *file_name_)
   NOT_REACHED ();
 }
 
+#ifdef VM
+/* What process_fork() passes to start_fork(). */
+struct fork_info
+  {
+    struct thread *parent;      /* Process being forked. */
+    struct intr_frame if_;      /* Its user registers at fork(). */
+  };
+
+/* Starts a new thread running a copy of the current user
+   process, which entered the kernel with user registers IF_ to
+   call fork().  The child returns to user space as if from the
+   same fork() call, which returns 0 in the child.  Writable
+   pages that the process has in memory are shared copy-on-write
+   (see vm/frame.c) rather than copied, so forking is cheap and
+   read-only data stays shared.  Waits until the child has copied
+   the process, and returns the new process's thread id, or
+   TID_ERROR if the thread cannot be created or the copy
+   fails. */
+tid_t
+process_fork (const struct intr_frame *if_)
+{
+  struct thread *cur = thread_current ();
+  struct child_process *cp;
+  struct fork_info info;
+  tid_t tid;
+
+  info.parent = cur;
+  info.if_ = *if_;
+  tid = thread_create (cur->name, PRI_DEFAULT, start_fork, &info);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+
+  /* INFO is on our stack, and our pages must stay as they are
+     until the child has copied them, so wait for it. */
+  cp = get_child_process (tid);
+  sema_down (&cp->load_sema);
+  if (cp->is_loaded == load_fail)
+    {
+      remove_child_process (cp);
+      return TID_ERROR;
+    }
+  return tid;
+}
+
+/* A thread function that copies the process that forked it and
+   starts it running. */
+static void
+start_fork (void *info_)
+{
+  struct fork_info *info = info_;
+  struct thread *t = thread_current ();
+  struct child_process *cp = t->cp;
+  struct intr_frame if_ = info->if_;
+  bool success = copy_process (info->parent);
+
+  /* Let the parent go.  If we failed, it frees CP. */
+  cp->is_loaded = success ? load_success : load_fail;
+  if (!success)
+    t->cp = NULL;
+  sema_up (&cp->load_sema);
+  if (!success)
+    thread_exit ();
+
+  /* Return to user space from fork(), returning 0, the way
+     start_process() starts a new process. */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Gives the current thread a copy of PARENT's address space,
+   executable, and file descriptors.  Returns true if successful,
+   false otherwise, in which case process_exit() frees whatever
+   was copied. */
+static bool
+copy_process (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+
+  t->pagedir = pagedir_create ();
+  if (t->pagedir == NULL || !page_table_init (&t->pages))
+    return false;
+  process_activate ();
+
+  /* Our PAGE_FILE pages read from our own copy of the
+     executable. */
+  lock_acquire (&file_lock);
+  t->is_executing = file_reopen (parent->is_executing);
+  if (t->is_executing != NULL)
+    file_deny_write (t->is_executing);
+  lock_release (&file_lock);
+  if (t->is_executing == NULL)
+    return false;
+
+  return syscall_copy_files (parent) && page_table_copy (parent);
+}
+#endif
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -145,11 +250,16 @@ process_exit (void)
   struct thread *cur = thread_current ();
   uint32_t *pd;
 
+  /* Let go of the pages of a system call that we are exiting
+     from before they are freed. */
+  syscall_unpin ();
+
   // Need lock
-  syscall_close(-1);      // exit every process
-  if (cur->is_executing){
-      file_close(cur->is_executing);
-  }
+  syscall_close(-1);// exit every process
+#ifdef VM
+  /* Write back and unmap every mapping while its file is open. */
+  syscall_unmap_all ();
+#endif
 
     // remove all of the child -> No 고아 프로세스 (orphan)
   struct list_elem *next;
@@ -158,16 +268,9 @@ process_exit (void)
   for (;e != list_end (&cur->child_list) ; e = next){
       next = list_next(e);
       struct child_process *cp = list_entry (e, struct child_process, elem);
-      list_remove(&cp->elem);
-      free(cp);
+      remove_child_process (cp);
   }
 
-    // kernel에 의해 종료되는 경우 체크
-  if (thread_alive(cur->parent) && cur->cp && cur->is_executing)
-  {
-    cur->cp->exit = true;
-    sema_up(&cur->cp->exit_sema);
-  }
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
@@ -180,10 +283,31 @@ process_exit (void)
          directory before destroying the process's page
          directory, or our active page directory will be one
          that's been freed (and cleared). */
+#ifdef VM
+      /* Free our pages and swap slots first, while the page
+         directory still maps them. */
+      page_table_destroy (&cur->pages);
+#endif
       cur->pagedir = NULL;
       pagedir_activate (NULL);
       pagedir_destroy (pd);
     }
+
+  /* Close the executable only now that our pages are gone, since
+     VM's text cache identifies them by its inode.  Whether we
+     had one tells whether we ran at all. */
+  bool loaded = cur->is_executing != NULL;
+  if (cur->is_executing){
+      file_close(cur->is_executing);
+      cur->is_executing = NULL;
+  }
+
+    // kernel에 의해 종료되는 경우 체크
+  if (thread_alive(cur->parent) && cur->cp && loaded)
+  {
+    cur->cp->exit = true;
+    sema_up(&cur->cp->exit_sema);
+  }
 }
 
 /* Sets up the CPU for running user code in the current
@@ -304,6 +428,10 @@ printf("\n");
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL)
     goto done;
+#ifdef VM
+  if (!page_table_init (&t->pages))
+    goto done;
+#endif
   process_activate ();
 
   /* Open executable file. */
@@ -408,7 +536,9 @@ printf("\n");
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -467,6 +597,12 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With VM, the pages are only recorded in the process's
+   supplemental page table, to be read or zeroed when the
+   process first touches them (see vm/page.c).  FILE stays open
+   until the process exits, as the "is_executing" member of
+   struct thread.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -486,6 +622,12 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+      /* Record where this page comes from. */
+      if (!page_add_file (upage, file, ofs, page_read_bytes, writable))
+        return false;
+      ofs += page_read_bytes;
+#else
       /* Get a page of memory. */
       uint8_t *kpage = palloc_get_page (PAL_USER);
       if (kpage == NULL)
@@ -505,6 +647,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           palloc_free_page (kpage);
           return false;
         }
+#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
@@ -519,7 +662,9 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack (void **esp,char* filename,char** rest_of_filename)
 {
+#ifndef VM
   uint8_t *kpage;
+#endif
   bool success = false;
   char* argument;
   char** argv;
@@ -529,6 +674,14 @@ setup_stack (void **esp,char* filename,char** rest_of_filename)
 int count=0;
 
   uint32_t esp_temp;
+#ifdef VM
+  /* The stack page goes in the supplemental page table too, so
+     that it can be evicted like any other. */
+  success = (page_add_zero (((uint8_t *) PHYS_BASE) - PGSIZE, true)
+             && page_load (((uint8_t *) PHYS_BASE) - PGSIZE));
+  if (success)
+    *esp = PHYS_BASE;
+#else
   kpage = palloc_get_page (PAL_USER | PAL_ZERO);
   if (kpage != NULL)
     {
@@ -538,6 +691,7 @@ int count=0;
       else
         palloc_free_page (kpage);
     }
+#endif
 
   for(i=0;(*rest_of_filename)[i]!=NULL;i++)
   {
@@ -601,6 +755,7 @@ int count=0;
    with palloc_get_page().
    Returns true on success, false if UPAGE is already mapped or
    if memory allocation fails. */
+#ifndef VM
 static bool
 install_page (void *upage, void *kpage, bool writable)
 {
@@ -611,3 +766,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
@@ -6,11 +6,16 @@
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
+#include "threads/slab.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 
+#include "userprog/pagedir.h"
 #include "userprog/process.h"
 #include "devices/shutdown.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 struct file_element {
   struct file *file;
@@ -18,6 +23,26 @@ struct file_element {
   struct list_elem elem;
 };
 
+#ifdef VM
+/* A file mapped into memory by mmap().  The mapping has its own
+   reopened file, so that it survives close() of the descriptor
+   it was made from. */
+struct mapping
+  {
+    int mapid;                  /* Identifier returned by mmap(). */
+    struct file *file;          /* File mapped. */
+    uint8_t *base;              /* User address of first page. */
+    size_t page_cnt;            /* Number of pages mapped. */
+    struct list_elem elem;      /* Element in struct thread's "mappings". */
+  };
+
+static struct kmem_cache *mapping_cache;
+#endif
+
+/* Caches of open file descriptors and child process records. */
+static struct kmem_cache *file_element_cache;
+static struct kmem_cache *child_process_cache;
+
 static void syscall_handler (struct intr_frame *);
 void syscall_halt();
 void syscall_exit(int status);
@@ -31,17 +56,37 @@ int syscall_read (int fd, void *buffer, unsigned size);
 int syscall_write (int fd, const void *buffer, unsigned size);
 void syscall_seek(int fd, unsigned position);
 unsigned syscall_tell(int fd);
+#ifdef VM
+int syscall_mmap (int fd, void *addr);
+void syscall_munmap (int mapid);
+static void unmap (struct mapping *);
+#endif
 
 void cp_load_check(struct child_process* cp);
 void get_argument (struct intr_frame *f, int *arg, int n);
 void check_valid_ptr (const void *vaddr);
 int get_kernel_pointer_addr(const void *vaddr);
+static bool page_present (const void *upage);
+static bool page_writable (const void *upage);
+static void load_buffer (const void *buffer, unsigned size, bool writable);
+static void pin_pages (const void *upage, size_t page_cnt, bool writable);
 struct file* get_file_fd(int fd);
 
 void
 syscall_init (void)
 {
   lock_init(&file_lock);
+  file_element_cache = kmem_cache_create ("file_element",
+                                          sizeof (struct file_element), 0);
+  child_process_cache = kmem_cache_create ("child_process",
+                                           sizeof (struct child_process), 0);
+  if (file_element_cache == NULL || child_process_cache == NULL)
+    PANIC ("out of memory creating system call caches");
+#ifdef VM
+  mapping_cache = kmem_cache_create ("mapping", sizeof (struct mapping), 0);
+  if (mapping_cache == NULL)
+    PANIC ("out of memory creating system call caches");
+#endif
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
@@ -97,16 +142,16 @@ syscall_handler (struct intr_frame *f UNUSED)
   case SYS_READ:
     get_argument(f,arg,3);
     check_valid_buffer((void*)arg[1],(unsigned)arg[2]); // for bad-read case
+    load_buffer((void*)arg[1],(unsigned)arg[2],true);
     arg[0] = (int) arg[0];      // file descriptor
-    arg[1] = get_kernel_pointer_addr((const void*)arg[1]);  // file buffer
     arg[2] = (unsigned) arg[2];
     f->eax = syscall_read(arg[0],arg[1],arg[2]);
     break;
   case SYS_WRITE:
     get_argument(f,arg,3);
     check_valid_buffer((void*)arg[1],(unsigned)arg[2]);// for bad-write case
+    load_buffer((void*)arg[1],(unsigned)arg[2],false);
     arg[0] = (int)arg[0];   // file descriptor
-    arg[1] = get_kernel_pointer_addr((const void*) arg[1]); // file buffer (contents)
     arg[2] = (unsigned)arg[2]; // file size
     f->eax = syscall_write(arg[0], arg[1], arg[2]);
     break;
@@ -122,10 +167,24 @@ syscall_handler (struct intr_frame *f UNUSED)
     get_argument(f,arg,1);
     syscall_close(arg[0]);
     break;
+#ifdef VM
+  case SYS_MMAP:
+    get_argument(f,arg,2);
+    f->eax = syscall_mmap(arg[0], (void *) arg[1]);
+    break;
+  case SYS_MUNMAP:
+    get_argument(f,arg,1);
+    syscall_munmap(arg[0]);
+    break;
+  case SYS_FORK:
+    f->eax = process_fork(f);
+    break;
+#endif
   dafault:
     printf("Error loading syscall, syscall num : %d\n",*((int*)f->esp));
     thread_exit ();
   }
+  syscall_unpin ();
 }
 
 void syscall_halt()
@@ -204,7 +263,7 @@ int syscall_open (const char *file)
     returnVal = -1;
   }  // file is not open
   else {
-    struct file_element *file_pointer = malloc(sizeof(struct file_element));
+    struct file_element *file_pointer = kmem_cache_alloc (file_element_cache);
     if(!file_pointer){
       return -1;
     }
@@ -316,7 +375,7 @@ void syscall_close(int fd){
     if(fd == file_pointer->fd || fd == -1){
       file_close(file_pointer->file);
       list_remove(&file_pointer->elem);
-      free(file_pointer);
+      kmem_cache_free (file_element_cache, file_pointer);
       break;
     }
     if(fd != -1){
@@ -328,6 +387,156 @@ void syscall_close(int fd){
   lock_release(&file_lock);
 }
 
+#ifdef VM
+/* Maps the file open as FD into the process's address space,
+   starting at page-aligned user address ADDR, and returns an
+   identifier for the mapping, or -1 on failure.  The pages are
+   read from the file only when the process touches them (see
+   vm/page.c), and only the ones it modifies are written back. */
+int
+syscall_mmap (int fd, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct mapping *m;
+  struct file *file;
+  off_t length;
+  size_t i;
+
+  if (fd == STDIN_FILENO || fd == STDOUT_FILENO
+      || addr == NULL || pg_ofs (addr) != 0 || !is_user_vaddr (addr))
+    return -1;
+
+  lock_acquire (&file_lock);
+  file = get_file_fd (fd);
+  file = file != NULL ? file_reopen (file) : NULL;
+  length = file != NULL ? file_length (file) : 0;
+  lock_release (&file_lock);
+
+  /* The mapping must fit in user memory, and it may not overlap
+     any page the process already has, including its stack. */
+  if (file == NULL || length == 0
+      || (size_t) length > (size_t) ((uint8_t *) PHYS_BASE
+                                     - (uint8_t *) addr))
+    goto fail;
+  m = kmem_cache_alloc (mapping_cache);
+  if (m == NULL)
+    goto fail;
+  m->file = file;
+  m->base = addr;
+  m->page_cnt = 0;
+  for (i = 0; i < (size_t) length; i += PGSIZE)
+    {
+      size_t read_bytes = length - i < PGSIZE ? length - i : PGSIZE;
+      if (page_exists (m->base + i)
+          || !page_add_mmap (m->base + i, file, i, read_bytes))
+        {
+          unmap (m);
+          return -1;
+        }
+      m->page_cnt++;
+    }
+
+  m->mapid = t->next_mapid++;
+  list_push_back (&t->mappings, &m->elem);
+  return m->mapid;
+
+ fail:
+  if (file != NULL)
+    {
+      lock_acquire (&file_lock);
+      file_close (file);
+      lock_release (&file_lock);
+    }
+  return -1;
+}
+
+/* Unmaps the mapping with identifier MAPID, writing its modified
+   pages back to its file.  Does nothing if the process has no
+   such mapping. */
+void
+syscall_munmap (int mapid)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (mapid == m->mapid)
+        {
+          list_remove (&m->elem);
+          unmap (m);
+          return;
+        }
+    }
+}
+
+/* Unmaps every mapping of the current process, as when it
+   exits, writing modified pages back to their files. */
+void
+syscall_unmap_all (void)
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->mappings))
+    unmap (list_entry (list_pop_front (&t->mappings), struct mapping,
+                       elem));
+}
+
+/* Gives the current process, a child that PARENT is forking, a
+   copy of each of PARENT's file descriptors, open on the same
+   file at the same position.  The two processes' positions move
+   independently afterward.  Returns false on memory allocation
+   failure. */
+bool
+syscall_copy_files (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+  bool success = true;
+
+  lock_acquire (&file_lock);
+  for (e = list_begin (&parent->file_list);
+       e != list_end (&parent->file_list); e = list_next (e))
+    {
+      struct file_element *pf = list_entry (e, struct file_element, elem);
+      struct file_element *cf = kmem_cache_alloc (file_element_cache);
+
+      if (cf == NULL || (cf->file = file_reopen (pf->file)) == NULL)
+        {
+          if (cf != NULL)
+            kmem_cache_free (file_element_cache, cf);
+          success = false;
+          break;
+        }
+      file_seek (cf->file, file_tell (pf->file));
+      cf->fd = pf->fd;
+      list_push_back (&t->file_list, &cf->elem);
+    }
+  t->fd = parent->fd;
+  lock_release (&file_lock);
+  return success;
+}
+
+/* Removes M's pages from the supplemental page table, writing
+   back the ones that were modified, then closes M's file and
+   frees M. */
+static void
+unmap (struct mapping *m)
+{
+  size_t i;
+
+  for (i = 0; i < m->page_cnt; i++)
+    page_remove (m->base + PGSIZE * i);
+
+  lock_acquire (&file_lock);
+  file_close (m->file);
+  lock_release (&file_lock);
+  kmem_cache_free (mapping_cache, m);
+}
+#endif
+
 struct file* get_file_fd(int fd){
   struct thread *t = thread_current();
   struct list_elem *e;
@@ -335,7 +544,7 @@ struct file* get_file_fd(int fd){
   for(e = list_begin(&t->file_list); e != list_end(&t->file_list);e = list_next(e)){
     struct file_element *file_pointer = list_entry(e, struct file_element,elem);
     // file_list 중 fd가 parameter로 들어온 fd와 같으면 해당 파일 return
-    if(fd = file_pointer->fd){
+    if(fd == file_pointer->fd){
       return file_pointer->file;
     }
   }
@@ -370,9 +579,117 @@ void check_valid_buffer (void* buffer, int size){
   }
 }
 
+/* Makes sure that user page UPAGE is in memory, bringing it in
+   if it is not there yet.  Returns true if it is now present,
+   false if the process has no such page. */
+static bool
+page_present (const void *upage)
+{
+  if (pagedir_get_page (thread_current ()->pagedir, upage) != NULL)
+    return true;
+#ifdef VM
+  return page_load (upage);
+#else
+  return false;
+#endif
+}
+
+/* Makes sure that user page UPAGE, which is present, is mapped
+   writable, giving the process its own copy first if it shares
+   the page after fork().  Returns true if it is now writable,
+   false if the process may not write to it. */
+static bool
+page_writable (const void *upage)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+
+  if (pagedir_is_writable (pd, upage))
+    return true;
+#ifdef VM
+  return page_unshare (upage) && pagedir_is_writable (pd, upage);
+#else
+  return false;
+#endif
+}
+
+/* Pins every page of the SIZE bytes at user address BUFFER in
+   memory until the system call returns, making sure they are
+   writable if WRITABLE is true, so that read() and write() can
+   use BUFFER directly even if it spans pages.  Kills the process
+   if a page is missing or read-only.  check_valid_buffer() must
+   already have checked that BUFFER is in user memory. */
+static void
+load_buffer (const void *buffer, unsigned size, bool writable)
+{
+  const uint8_t *upage = pg_round_down (buffer);
+  const uint8_t *end = (const uint8_t *) buffer + size;
+
+  if (size == 0)
+    return;
+  pin_pages (upage, pg_no (end - 1) - pg_no (upage) + 1, writable);
+}
+
+/* Pins the PAGE_CNT user pages starting at UPAGE, recording them
+   as a range in the current thread's "pins", so that they are
+   neither moved by compaction (see palloc.c) nor evicted (see
+   vm/frame.c) until syscall_unpin().  If WRITABLE is true, makes
+   sure they are writable.  Kills the process if a page is
+   missing or read-only, with the pages pinned so far recorded
+   for process_exit() to unpin. */
+static void
+pin_pages (const void *upage, size_t page_cnt, bool writable)
+{
+  struct thread *t = thread_current ();
+  struct pin_range *r;
+
+  ASSERT (t->pin_cnt < PIN_MAX);
+  r = &t->pins[t->pin_cnt++];
+  r->upage = upage;
+  r->page_cnt = 0;
+  while (r->page_cnt < page_cnt)
+    {
+      const uint8_t *p = r->upage + PGSIZE * r->page_cnt;
+
+      /* Giving the process its own copy of a page that it shares
+         moves the page to another frame, so do that before
+         pinning it. */
+      if (!page_present (p) || (writable && !page_writable (p)))
+        syscall_exit (-1);
+#ifdef VM
+      if (!page_pin (p))
+        syscall_exit (-1);
+#endif
+      r->page_cnt++;
+    }
+}
+
+/* Unpins the pages that the current system call pinned.  Called
+   when the system call returns, and by process_exit() in case the
+   process exits in the middle of one. */
+void
+syscall_unpin (void)
+{
+  struct thread *t = thread_current ();
+
+  while (t->pin_cnt > 0)
+    {
+      struct pin_range *r = &t->pins[t->pin_cnt - 1];
+
+      while (r->page_cnt > 0)
+        {
+          r->page_cnt--;
+#ifdef VM
+          page_unpin (r->upage + PGSIZE * r->page_cnt);
+#endif
+        }
+      t->pin_cnt--;
+    }
+}
+
 int get_kernel_pointer_addr(const void *vaddr)
 {
   check_valid_ptr(vaddr);
+  pin_pages (pg_round_down (vaddr), 1, false);
   void *ptr = pagedir_get_page(thread_current()->pagedir, vaddr);
   if (!ptr){
       syscall_exit(-1); // error case
@@ -383,7 +700,7 @@ int get_kernel_pointer_addr(const void *vaddr)
 
 struct child_process* add_child_process (int pid)
 {
-  struct child_process* cp = malloc(sizeof(struct child_process));
+  struct child_process* cp = kmem_cache_alloc (child_process_cache);
   if (!cp){
       return NULL;
   }
@@ -416,5 +733,5 @@ struct child_process* get_child_process (int pid)
 void remove_child_process (struct child_process *cp)
 {
   list_remove(&cp->elem);
-  free(cp);
+  kmem_cache_free (child_process_cache, cp);
 }
@@ -28,3 +28,9 @@ struct child_process* get_child_process (int pid);
 void remove_child_process (struct child_process *cp);
 
 void syscall_close(int fd);
+void syscall_unpin (void);
+#ifdef VM
+struct thread;
+void syscall_unmap_all (void);
+bool syscall_copy_files (struct thread *parent);
+#endif
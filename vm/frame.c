@@ -0,0 +1,738 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/interrupt.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/syscall.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* Frame table.
+
+   Every user page in memory has an entry in the frame table, a
+   list that the "clock" algorithm sweeps when the user pool runs
+   out of pages and a page has to be evicted to make room.  Each
+   entry records the page's kernel address and its supplemental
+   page table entries, which know their owners.  palloc.c's
+   compaction moves user pages by calling frame_migrate(), which
+   finds the page's entry through a hash table indexed by kernel
+   address and points its owners' page table entries at the new
+   page.  It does so only while holding frame_lock, so a page
+   cannot move while frame.c is working on it, and it leaves
+   pinned pages alone, so a page also keeps its kernel address
+   while it is being loaded or a system call is using it.
+
+   A frame usually belongs to a single page of a single process.
+   After fork(), though, parent and child share each page that
+   the parent had in memory, so the frame's list holds both
+   processes' entries, and both map the page read-only.  A write
+   to the page faults, and frame_unshare() gives the writer a
+   copy of its own, or just makes the page writable again if no
+   other process still shares it.  Page table entries of a shared
+   page have matching dirty bits, because fork() copies the
+   parent's and no process can write the page while it is shared.
+
+   Processes running the same program share its read-only pages
+   too.  The text cache indexes the frames that hold read-only
+   pages of executables by inode, offset, and length.  When a
+   process first touches such a page, page_load() calls
+   frame_share_text(), which maps the frame that another process
+   already loaded, if there is one, instead of reading the page
+   again.  A frame leaves the cache when the last process using
+   it unmaps it or when it is evicted.  Processes keep their
+   executables open until their pages are gone, so an inode in
+   the cache cannot be freed and reused for another file.
+
+   The clock hand passes over pages whose accessed bits are set,
+   clearing the bits, and evicts the first page whose accessed
+   bits are already clear: a "second chance" algorithm.  It skips
+   pinned pages: those being loaded, and those that a system call
+   is using (see syscall.c), each pinned until it is done.  An
+   evicted page that was modified, or whose only copy is in
+   memory, is written to swap, except that a modified page of a
+   file mapping is written back to its file.  A clean page is
+   simply dropped, to be read again from its file or zeroed.  A
+   shared page is unmapped from every process that shares it, and
+   all of them share its swap slot.
+
+   frame_lock protects the table and serializes eviction.  A
+   process that touches a page while it is being evicted faults
+   and waits for frame_lock in frame_alloc(), by which time the
+   page is safely in swap or its file.  Locking order: the file
+   system lock may be held when frame_lock is acquired, but not
+   the other way around.  So eviction only writes back a file
+   mapping's page if it can get the file system lock without
+   waiting for it. */
+
+/* Cache of struct frame. */
+static struct kmem_cache *frame_cache;
+
+/* Frame table, clock hand, and number of entries, all protected
+   by frame_lock.  A null hand stands for the beginning of the
+   list. */
+static struct lock frame_lock;
+static struct list frame_list;
+static struct list_elem *clock_hand;
+static size_t frame_cnt;
+
+/* Statistics. */
+static long long eviction_cnt;          /* Pages evicted. */
+static long long dropped_cnt;           /* Clean pages not written out. */
+static long long share_cnt;             /* Pages shared by fork(). */
+static long long copy_cnt;              /* Shared pages copied on write. */
+static long long text_share_cnt;        /* Pages found in text cache. */
+
+/* Text cache: frames that hold read-only executable pages,
+   indexed by inode, offset, and length.  Protected by
+   frame_lock. */
+static struct hash text_frames;
+
+/* Frame table entries indexed by kernel address, for
+   compaction.  Protected by frame_lock. */
+static struct hash kpage_frames;
+
+static hash_hash_func text_hash;
+static hash_less_func text_less;
+static hash_hash_func kpage_hash;
+static hash_less_func kpage_less;
+
+static void *evict (void);
+static struct frame *choose_victim (bool *file_locked);
+static bool is_shared (struct frame *);
+static bool is_dirty (const struct page *);
+static bool test_and_clear_accessed (struct frame *);
+static bool is_text (const struct page *);
+static void unmap (struct frame *);
+static void remap (struct frame *);
+static void insert_frame (struct frame *);
+static void remove_frame (struct frame *);
+
+/* Initializes the frame table. */
+void
+frame_init (void) 
+{
+  frame_cache = kmem_cache_create ("frame", sizeof (struct frame), 0);
+  if (frame_cache == NULL)
+    PANIC ("out of memory creating frame cache");
+  lock_init (&frame_lock);
+  list_init (&frame_list);
+  if (!hash_init (&text_frames, text_hash, text_less, NULL))
+    PANIC ("out of memory creating text cache");
+  if (!hash_init (&kpage_frames, kpage_hash, kpage_less, NULL))
+    PANIC ("out of memory creating frame table");
+}
+
+/* Obtains a page of memory for P, a page of the current process
+   that is not in memory, evicting another page if the user pool
+   is exhausted, and adds it to the frame table.  If PAL_ZERO is
+   set in FLAGS, the page is zeroed.  Returns the page's kernel
+   virtual address, or a null pointer if no page can be had.
+
+   The new frame is pinned: the caller must fill the page, map
+   it, and then call frame_unpin(), or call frame_free() if it
+   cannot. */
+void *
+frame_alloc (struct page *p, enum palloc_flags flags) 
+{
+  struct frame *f = kmem_cache_alloc (frame_cache);
+  void *kpage;
+
+  if (f == NULL)
+    return NULL;
+
+  lock_acquire (&frame_lock);
+  ASSERT (p->frame == NULL);
+  kpage = palloc_get_page (PAL_USER | flags);
+  if (kpage == NULL)
+    {
+      kpage = evict ();
+      if (kpage != NULL && (flags & PAL_ZERO))
+        memset (kpage, 0, PGSIZE);
+    }
+  if (kpage != NULL)
+    {
+      f->kpage = kpage;
+      list_init (&f->pages);
+      list_push_back (&f->pages, &p->frame_elem);
+      f->pin_cnt = 1;
+      f->inode = NULL;
+      insert_frame (f);
+      p->frame = f;
+    }
+  else
+    kmem_cache_free (frame_cache, f);
+  lock_release (&frame_lock);
+
+  return kpage;
+}
+
+/* Undoes one frame_alloc() or frame_pin() of P's frame, which
+   P's owner has mapped, making it eligible for eviction once
+   nothing else pins it.  If P is a read-only page of an
+   executable, also adds the frame to the text cache, unless
+   another process has cached the same page already. */
+void
+frame_unpin (struct page *p) 
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = p->frame;
+  ASSERT (f != NULL && f->pin_cnt > 0);
+  f->pin_cnt--;
+  if (is_text (p) && f->inode == NULL)
+    {
+      f->inode = file_get_inode (p->file);
+      f->ofs = p->ofs;
+      f->read_bytes = p->read_bytes;
+      if (hash_insert (&text_frames, &f->text_elem) != NULL)
+        f->inode = NULL;
+    }
+  lock_release (&frame_lock);
+}
+
+/* If P is in memory, pins its frame so that it cannot be
+   evicted, and returns true.  Returns false if P is not in
+   memory.  The frame stays pinned until a matching
+   frame_unpin(), or until P is released. */
+bool
+frame_pin (struct page *p) 
+{
+  bool resident;
+
+  lock_acquire (&frame_lock);
+  resident = p->frame != NULL;
+  if (resident)
+    p->frame->pin_cnt++;
+  lock_release (&frame_lock);
+  return resident;
+}
+
+/* Undoes frame_alloc() for P, whose page KPAGE has not been
+   mapped, and frees KPAGE. */
+void
+frame_free (struct page *p, void *kpage) 
+{
+  lock_acquire (&frame_lock);
+  ASSERT (p->frame != NULL && p->frame->pin_cnt > 0);
+  remove_frame (p->frame);
+  lock_release (&frame_lock);
+  palloc_free_page (kpage);
+}
+
+/* If P is in memory, unmaps it from its owner's page directory
+   and drops it from its frame.  If no other process shares the
+   frame, also frees its page and removes it from the frame
+   table.  Called by P's owner when it unmaps P or exits. */
+void
+frame_release (struct page *p) 
+{
+  void *kpage = NULL;
+
+  lock_acquire (&frame_lock);
+  if (p->frame != NULL && is_shared (p->frame))
+    {
+      pagedir_clear_page (p->owner->pagedir, p->upage);
+      list_remove (&p->frame_elem);
+      p->frame = NULL;
+    }
+  else if (p->frame != NULL)
+    {
+      kpage = p->frame->kpage;
+      unmap (p->frame);
+      remove_frame (p->frame);
+    }
+  lock_release (&frame_lock);
+  if (kpage != NULL)
+    palloc_free_page (kpage);
+}
+
+/* Makes COPY, the same page of a child that is being forked,
+   start out with P's contents.  If P is in memory, COPY shares
+   P's frame: the page is mapped read-only in COPY's owner's page
+   directory, which must be the current process, and made
+   read-only in P's owner's too.  Otherwise, COPY shares P's swap
+   slot, if P has one.  P's owner must be waiting for the fork,
+   but P may still be evicted, so COPY's type is taken from P
+   here, under frame_lock.  Returns false if the child's page
+   table cannot be allocated, true otherwise. */
+bool
+frame_share (struct page *p, struct page *copy) 
+{
+  uint32_t *pd = p->owner->pagedir;
+  bool success = true;
+
+  ASSERT (copy->owner == thread_current ());
+
+  lock_acquire (&frame_lock);
+  copy->type = p->type;
+  if (p->frame != NULL)
+    {
+      bool dirty = pagedir_is_dirty (pd, p->upage);
+
+      pagedir_set_writable (pd, p->upage, false);
+      success = pagedir_set_page (copy->owner->pagedir, copy->upage,
+                                  p->frame->kpage, false);
+      if (success)
+        pagedir_set_dirty (copy->owner->pagedir, copy->upage, dirty);
+      if (success)
+        {
+          list_push_back (&p->frame->pages, &copy->frame_elem);
+          copy->frame = p->frame;
+          share_cnt++;
+        }
+    }
+  else if (p->swap_slot != SWAP_ERROR)
+    {
+      copy->swap_slot = p->swap_slot;
+      swap_share (copy->swap_slot);
+    }
+  lock_release (&frame_lock);
+  return success;
+}
+
+/* Makes P, a writable page of the current process that is mapped
+   read-only because it was shared after fork(), writable again.
+   If another process still shares P's frame, first copies P to a
+   frame of its own, evicting another page if the user pool is
+   exhausted.  Returns false if no page of memory can be had.
+   Returns true without doing anything if P is no longer in
+   memory, because the fault that brought us here will then
+   recur and load it. */
+bool
+frame_unshare (struct page *p) 
+{
+  struct frame *f = kmem_cache_alloc (frame_cache);
+  uint32_t *pd = p->owner->pagedir;
+  struct frame *old;
+  void *kpage;
+  bool dirty;
+
+  ASSERT (p->owner == thread_current ());
+  ASSERT (p->writable);
+
+  if (f == NULL)
+    return false;
+
+  lock_acquire (&frame_lock);
+  old = p->frame;
+  if (old == NULL || !is_shared (old))
+    {
+      if (old != NULL)
+        pagedir_set_writable (pd, p->upage, true);
+      lock_release (&frame_lock);
+      kmem_cache_free (frame_cache, f);
+      return true;
+    }
+
+  /* Keep the clock from choosing the page we are copying. */
+  old->pin_cnt++;
+  kpage = palloc_get_page (PAL_USER);
+  if (kpage == NULL)
+    kpage = evict ();
+  old->pin_cnt--;
+  if (kpage == NULL)
+    {
+      lock_release (&frame_lock);
+      kmem_cache_free (frame_cache, f);
+      return false;
+    }
+
+  /* The page table already exists, so pagedir_set_page() cannot
+     fail. */
+  memcpy (kpage, old->kpage, PGSIZE);
+  dirty = pagedir_is_dirty (pd, p->upage);
+  pagedir_clear_page (pd, p->upage);
+  pagedir_set_page (pd, p->upage, kpage, true);
+  pagedir_set_dirty (pd, p->upage, dirty);
+
+  list_remove (&p->frame_elem);
+  f->kpage = kpage;
+  list_init (&f->pages);
+  list_push_back (&f->pages, &p->frame_elem);
+  f->pin_cnt = 0;
+  f->inode = NULL;
+  insert_frame (f);
+  p->frame = f;
+  copy_cnt++;
+  lock_release (&frame_lock);
+  return true;
+}
+
+/* If P, a page of the current process that is not in memory, is
+   a read-only page of an executable that another process has in
+   memory, maps that process's frame into the current process's
+   page directory and returns true.  Otherwise, returns false,
+   and the caller should load P itself. */
+bool
+frame_share_text (struct page *p) 
+{
+  struct frame key;
+  struct hash_elem *e;
+  bool success = false;
+
+  ASSERT (p->owner == thread_current ());
+
+  if (!is_text (p))
+    return false;
+  key.inode = file_get_inode (p->file);
+  key.ofs = p->ofs;
+  key.read_bytes = p->read_bytes;
+
+  lock_acquire (&frame_lock);
+  ASSERT (p->frame == NULL);
+  e = hash_find (&text_frames, &key.text_elem);
+  if (e != NULL)
+    {
+      struct frame *f = hash_entry (e, struct frame, text_elem);
+
+      success = pagedir_set_page (p->owner->pagedir, p->upage, f->kpage,
+                                  false);
+      if (success)
+        {
+          list_push_back (&f->pages, &p->frame_elem);
+          p->frame = f;
+          text_share_cnt++;
+        }
+    }
+  lock_release (&frame_lock);
+  return success;
+}
+
+/* Moves the user page at kernel virtual address PAGE to
+   NEW_PAGE, for palloc.c's compaction, and points every page
+   table entry that maps it at NEW_PAGE.  Returns true if
+   successful.  Returns false, leaving PAGE where it is, if PAGE
+   is not in the frame table or is pinned, or if frame_lock is
+   not free, in which case the caller keeps NEW_PAGE. */
+bool
+frame_migrate (void *page, void *new_page) 
+{
+  struct frame key;
+  struct hash_elem *e;
+  bool moved = false;
+
+  /* Compaction runs on behalf of whichever thread is allocating
+     pages, which may hold frame_lock already or be in the way of
+     a thread that does, so it never waits for the lock. */
+  if (lock_held_by_current_thread (&frame_lock)
+      || !lock_try_acquire (&frame_lock))
+    return false;
+  key.kpage = page;
+  e = hash_find (&kpage_frames, &key.kpage_elem);
+  if (e != NULL)
+    {
+      struct frame *f = hash_entry (e, struct frame, kpage_elem);
+
+      if (f->pin_cnt == 0)
+        {
+          struct list_elem *pe;
+          enum intr_level old_level;
+
+          /* Keep the page's owners from running, and modifying
+             it, while it is copied and remapped. */
+          old_level = intr_disable ();
+          memcpy (new_page, page, PGSIZE);
+          for (pe = list_begin (&f->pages); pe != list_end (&f->pages);
+               pe = list_next (pe))
+            {
+              struct page *p = list_entry (pe, struct page, frame_elem);
+              pagedir_move_page (p->owner->pagedir, p->upage, new_page);
+            }
+          intr_set_level (old_level);
+
+          hash_delete (&kpage_frames, &f->kpage_elem);
+          f->kpage = new_page;
+          hash_insert (&kpage_frames, &f->kpage_elem);
+          moved = true;
+        }
+    }
+  lock_release (&frame_lock);
+  return moved;
+}
+
+/* Prints frame table statistics. */
+void
+frame_print_stats (void) 
+{
+  printf ("Frames: %zu in use, %lld evicted, %lld of them clean, "
+          "%lld shared by fork, %lld copied on write, "
+          "%lld text pages shared\n",
+          frame_cnt, eviction_cnt, dropped_cnt, share_cnt, copy_cnt,
+          text_share_cnt);
+}
+
+/* Evicts a page chosen by the clock algorithm, writing it to
+   swap first if necessary, and returns its kernel virtual
+   address for reuse.  Returns a null pointer if no page can be
+   evicted or swap is full.  frame_lock must be held. */
+static void *
+evict (void) 
+{
+  bool file_locked = false;
+  struct frame *f = choose_victim (&file_locked);
+  struct list_elem *e;
+  struct page *p;
+  void *kpage;
+  bool dirty = false;
+
+  if (f == NULL)
+    return NULL;
+  p = list_entry (list_front (&f->pages), struct page, frame_elem);
+  kpage = f->kpage;
+
+  /* Unmap the page before writing it out, so that its owners
+     fault, and wait for us, if they touch the page again. */
+  unmap (f);
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    if (is_dirty (list_entry (e, struct page, frame_elem)))
+      dirty = true;
+
+  if (p->type == PAGE_MMAP)
+    {
+      /* File mappings are never shared. */
+      if (dirty)
+        page_write_back (p, kpage);
+      else
+        dropped_cnt++;
+      if (file_locked)
+        lock_release (&file_lock);
+    }
+  else if (dirty)
+    {
+      size_t slot = swap_out (kpage);
+      size_t ref_cnt = 0;
+
+      if (slot == SWAP_ERROR)
+        {
+          remap (f);
+          return NULL;
+        }
+      for (e = list_begin (&f->pages); e != list_end (&f->pages);
+           e = list_next (e))
+        {
+          struct page *q = list_entry (e, struct page, frame_elem);
+          if (is_dirty (q))
+            {
+              if (ref_cnt++ > 0)
+                swap_share (slot);
+              q->type = PAGE_SWAP;
+              q->swap_slot = slot;
+            }
+        }
+    }
+  else
+    dropped_cnt++;
+
+  remove_frame (f);
+  eviction_cnt++;
+  return kpage;
+}
+
+/* Advances the clock hand to a page that may be evicted and
+   returns its frame, or a null pointer if there is none.  If the
+   page belongs to a file mapping, this thread holds the file
+   system lock on return, and *FILE_LOCKED says whether we
+   acquired it here.  frame_lock must be held. */
+static struct frame *
+choose_victim (bool *file_locked) 
+{
+  size_t i;
+
+  /* In two trips around the clock, the first clears every
+     accessed bit that it passes, so the second finds a page
+     unless every page is pinned. */
+  for (i = 0; i < 2 * frame_cnt; i++) 
+    {
+      struct frame *f;
+      struct page *p;
+
+      if (clock_hand == NULL || clock_hand == list_end (&frame_list))
+        clock_hand = list_begin (&frame_list);
+      f = list_entry (clock_hand, struct frame, elem);
+      clock_hand = list_next (clock_hand);
+
+      if (f->pin_cnt > 0 || test_and_clear_accessed (f))
+        continue;
+      p = list_entry (list_front (&f->pages), struct page, frame_elem);
+      if (p->type != PAGE_MMAP || lock_held_by_current_thread (&file_lock))
+        return f;
+      else if (lock_try_acquire (&file_lock))
+        {
+          *file_locked = true;
+          return f;
+        }
+    }
+  return NULL;
+}
+
+/* Returns true if more than one page shares F. */
+static bool
+is_shared (struct frame *f) 
+{
+  return list_begin (&f->pages) != list_rbegin (&f->pages);
+}
+
+/* Returns true if P must be written out when it is evicted:
+   either its owner modified it or its only copy is in memory. */
+static bool
+is_dirty (const struct page *p) 
+{
+  return (p->type == PAGE_SWAP
+          || pagedir_is_dirty (p->owner->pagedir, p->upage));
+}
+
+/* Clears the accessed bits of F's page in every page directory
+   that maps it, and returns true if any of them was set. */
+static bool
+test_and_clear_accessed (struct frame *f) 
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      uint32_t *pd = p->owner->pagedir;
+
+      if (pagedir_is_accessed (pd, p->upage))
+        {
+          pagedir_set_accessed (pd, p->upage, false);
+          accessed = true;
+        }
+    }
+  return accessed;
+}
+
+/* Returns true if P is a read-only page of an executable, which
+   belongs in the text cache when it is in memory. */
+static bool
+is_text (const struct page *p) 
+{
+  return p->type == PAGE_FILE && !p->writable;
+}
+
+/* Unmaps F's page from every page directory that maps it.
+   frame_lock must be held. */
+static void
+unmap (struct frame *f) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+
+      ASSERT (pagedir_get_page (p->owner->pagedir, p->upage) == f->kpage);
+      pagedir_clear_page (p->owner->pagedir, p->upage);
+    }
+}
+
+/* Maps F's page back into the page directories that unmap()
+   removed it from, as it was, because it could not be evicted
+   after all.  The page tables already exist, so this cannot
+   fail.  frame_lock must be held. */
+static void
+remap (struct frame *f) 
+{
+  bool writable = !is_shared (f);
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      uint32_t *pd = p->owner->pagedir;
+      bool dirty = pagedir_is_dirty (pd, p->upage);
+
+      pagedir_set_page (pd, p->upage, f->kpage, p->writable && writable);
+      pagedir_set_dirty (pd, p->upage, dirty);
+    }
+}
+
+/* Adds F to the frame table just behind the hand, so that it is
+   the last frame the hand comes to.  frame_lock must be held. */
+static void
+insert_frame (struct frame *f) 
+{
+  list_insert (clock_hand != NULL ? clock_hand : list_end (&frame_list),
+               &f->elem);
+  hash_insert (&kpage_frames, &f->kpage_elem);
+  frame_cnt++;
+}
+
+/* Removes F from the frame table and frees it.  frame_lock must
+   be held. */
+static void
+remove_frame (struct frame *f) 
+{
+  struct list_elem *e;
+
+  if (clock_hand == &f->elem)
+    clock_hand = list_next (clock_hand);
+  list_remove (&f->elem);
+  hash_delete (&kpage_frames, &f->kpage_elem);
+  frame_cnt--;
+  if (f->inode != NULL)
+    hash_delete (&text_frames, &f->text_elem);
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    list_entry (e, struct page, frame_elem)->frame = NULL;
+  kmem_cache_free (frame_cache, f);
+}
+
+/* Returns a hash value for the text cache frame that E refers
+   to. */
+static unsigned
+text_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  const struct frame *f = hash_entry (e, struct frame, text_elem);
+  return hash_bytes (&f->inode, sizeof f->inode) ^ hash_int (f->ofs);
+}
+
+/* Returns true if the text cache frame that A refers to precedes
+   the one that B refers to. */
+static bool
+text_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED) 
+{
+  const struct frame *fa = hash_entry (a, struct frame, text_elem);
+  const struct frame *fb = hash_entry (b, struct frame, text_elem);
+
+  if (fa->inode != fb->inode)
+    return fa->inode < fb->inode;
+  else if (fa->ofs != fb->ofs)
+    return fa->ofs < fb->ofs;
+  else
+    return fa->read_bytes < fb->read_bytes;
+}
+
+/* Returns a hash value for the frame that E refers to, by its
+   kernel address. */
+static unsigned
+kpage_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  const struct frame *f = hash_entry (e, struct frame, kpage_elem);
+  return hash_int (pg_no (f->kpage));
+}
+
+/* Returns true if the frame that A refers to has a lower kernel
+   address than the one that B refers to. */
+static bool
+kpage_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED) 
+{
+  const struct frame *fa = hash_entry (a, struct frame, kpage_elem);
+  const struct frame *fb = hash_entry (b, struct frame, kpage_elem);
+
+  return fa->kpage < fb->kpage;
+}
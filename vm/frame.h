@@ -0,0 +1,42 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+#include "threads/palloc.h"
+
+struct inode;
+struct page;
+
+/* A user page in memory, in the frame table. */
+struct frame
+  {
+    struct list_elem elem;      /* Element in the frame table. */
+    struct hash_elem kpage_elem; /* Element in kpage_frames. */
+    void *kpage;                /* Kernel virtual address. */
+    struct list pages;          /* Supplemental page table entries. */
+    int pin_cnt;                /* Evictable only if 0. */
+
+    /* Read-only executable pages only; see frame.c. */
+    struct hash_elem text_elem; /* Element in the text cache. */
+    struct inode *inode;        /* Executable, or null if not cached. */
+    off_t ofs;                  /* Offset in INODE. */
+    size_t read_bytes;          /* Bytes read from INODE. */
+  };
+
+void frame_init (void);
+void *frame_alloc (struct page *, enum palloc_flags);
+void frame_unpin (struct page *);
+bool frame_pin (struct page *);
+void frame_free (struct page *, void *kpage);
+void frame_release (struct page *);
+bool frame_share (struct page *, struct page *copy);
+bool frame_unshare (struct page *);
+bool frame_share_text (struct page *);
+bool frame_migrate (void *page, void *new_page);
+void frame_print_stats (void);
+
+#endif /* vm/frame.h */
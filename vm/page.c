@@ -0,0 +1,480 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/syscall.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+/* Supplemental page table.
+
+   load() in process.c does not read an executable's segments
+   into memory.  It only records, in the process's supplemental
+   page table, where the contents of each page of each segment
+   come from: part of the executable file with the rest of the
+   page zeroed, or nothing but zeros.  A page is brought into
+   memory when the process first touches it, by page_fault()
+   calling page_load().  So exec() costs about the same for a big
+   program as for a small one, and pages that a program never
+   touches are never read.  Processes running the same program
+   share its read-only pages, so each such page is read once for
+   all of them while it stays in memory (see frame.c).
+
+   A page in memory may be evicted later (see frame.c).  If it
+   was clean, it is read or zeroed again next time, as before.
+   Otherwise it becomes a PAGE_SWAP page, which is read back from
+   swap.  A PAGE_SWAP page stays one after it is read back and
+   its swap slot is freed, because its only copy is then the one
+   in memory, which must be written out again if it is evicted.
+
+   Pages of files mapped with mmap() are PAGE_MMAP pages.  They
+   are read like PAGE_FILE pages, but they are never swapped:
+   when one is evicted or unmapped, it is written back to its
+   file if the process modified it, and otherwise just dropped.
+
+   fork() gives the child a copy of its parent's table, except
+   for file mappings, which the child does not inherit.  The two
+   processes share each page that was in memory, mapped read-only
+   in both, until one of them writes to it and page_unshare()
+   gives it a copy of its own (see frame.c).  They also share the
+   swap slots of pages that were in swap, until they read them
+   back.
+
+   Each process has its own table, struct thread's "pages"
+   member, a hash table keyed on user virtual address.  Only the
+   process itself adds and looks up entries, except that a child
+   being forked reads its parent's table while the parent waits
+   for it.  The frame table changes the "type", "frame", and
+   "swap_slot" members of an entry whose page is in memory, under
+   its frame_lock; while the page is out of memory, only the
+   owner touches them.  Entries stay in the table after their
+   pages are loaded. */
+
+/* Cache of struct page. */
+static struct kmem_cache *page_cache;
+
+/* Statistics. */
+static long long file_loads;            /* Pages read from files. */
+static long long zero_loads;            /* Pages zero-filled. */
+static long long write_backs;           /* Pages written to files. */
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_free;
+static struct page *page_create (void *upage, bool writable,
+                                 enum page_type);
+static bool page_insert (struct page *);
+static struct page *page_lookup (const void *upage);
+static bool read_page (struct page *, void *kpage);
+
+/* Initializes the supplemental page table module. */
+void
+page_init (void) 
+{
+  page_cache = kmem_cache_create ("page", sizeof (struct page), 0);
+  if (page_cache == NULL)
+    PANIC ("out of memory creating page cache");
+}
+
+/* Initializes PAGES as an empty supplemental page table.
+   Returns true if successful, false on memory allocation
+   failure. */
+bool
+page_table_init (struct hash *pages) 
+{
+  return hash_init (pages, page_hash, page_less, NULL);
+}
+
+/* Destroys supplemental page table PAGES and frees its entries,
+   along with the pages and swap slots they use.  Must be called
+   while the owner's page directory still exists.  Does nothing
+   if PAGES was never initialized, or page_table_init() failed on
+   it: struct thread starts out zeroed and a failed hash_init()
+   leaves no buckets behind. */
+void
+page_table_destroy (struct hash *pages) 
+{
+  if (pages->buckets != NULL)
+    hash_destroy (pages, page_free);
+}
+
+/* Fills the current process's empty supplemental page table with
+   a copy of PARENT's, for fork().  Pages that PARENT has in
+   memory are shared copy-on-write.  The current process's page
+   directory must already exist, and its executable must be open
+   as its "is_executing" member.  PARENT must wait until this
+   function returns.  Returns true if successful, false on memory
+   allocation failure, in which case the entries copied so far
+   stay in the table. */
+bool
+page_table_copy (struct thread *parent) 
+{
+  struct thread *t = thread_current ();
+  struct hash_iterator i;
+
+  hash_first (&i, &parent->pages);
+  while (hash_next (&i))
+    {
+      struct page *pp = hash_entry (hash_cur (&i), struct page, hash_elem);
+      struct page *p;
+
+      if (pp->type == PAGE_MMAP)
+        continue;
+
+      p = page_create (pp->upage, pp->writable, pp->type);
+      if (p == NULL)
+        return false;
+      if (pp->type == PAGE_FILE)
+        {
+          /* The parent's executable closes when it exits, so
+             read from our own. */
+          ASSERT (pp->file == parent->is_executing);
+          p->file = t->is_executing;
+          p->ofs = pp->ofs;
+          p->read_bytes = pp->read_bytes;
+        }
+      if (!page_insert (p) || !frame_share (pp, p))
+        return false;
+    }
+  return true;
+}
+
+/* Records in the current process's supplemental page table that
+   user page UPAGE is to be filled by reading READ_BYTES bytes,
+   at most PGSIZE, from FILE starting at offset OFS and zeroing
+   the rest.  The process may modify the page if WRITABLE is
+   true.  FILE must stay open as long as the process runs.
+   Returns true if successful, false if UPAGE is already in the
+   table or on memory allocation failure. */
+bool
+page_add_file (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes, bool writable) 
+{
+  struct page *p;
+
+  ASSERT (read_bytes <= PGSIZE);
+
+  if (read_bytes == 0)
+    return page_add_zero (upage, writable);
+
+  p = page_create (upage, writable, PAGE_FILE);
+  if (p == NULL)
+    return false;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  return page_insert (p);
+}
+
+/* Records in the current process's supplemental page table that
+   user page UPAGE is to be filled with zeros.  The process may
+   modify the page if WRITABLE is true.  Returns true if
+   successful, false if UPAGE is already in the table or on
+   memory allocation failure. */
+bool
+page_add_zero (void *upage, bool writable) 
+{
+  struct page *p = page_create (upage, writable, PAGE_ZERO);
+  return p != NULL && page_insert (p);
+}
+
+/* Records in the current process's supplemental page table that
+   user page UPAGE maps READ_BYTES bytes, at most PGSIZE, of FILE
+   starting at offset OFS, followed by zeros.  Changes that the
+   process makes to those bytes are written back to FILE.  FILE
+   must stay open until the page is removed.  Returns true if
+   successful, false if UPAGE is already in the table or on
+   memory allocation failure. */
+bool
+page_add_mmap (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes) 
+{
+  struct page *p;
+
+  ASSERT (read_bytes > 0 && read_bytes <= PGSIZE);
+
+  p = page_create (upage, true, PAGE_MMAP);
+  if (p == NULL)
+    return false;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  return page_insert (p);
+}
+
+/* Returns true if user page UPAGE is in the current process's
+   supplemental page table. */
+bool
+page_exists (const void *upage) 
+{
+  return page_lookup (upage) != NULL;
+}
+
+/* Brings the page that contains user virtual address ADDR into
+   memory and maps it in the current process's page directory.
+   Returns true if successful, false if ADDR is not in the
+   process's supplemental page table or if no page of memory can
+   be obtained, even by evicting one, or the page cannot be
+   read. */
+bool
+page_load (const void *addr) 
+{
+  struct thread *t = thread_current ();
+  struct page *p = page_lookup (pg_round_down (addr));
+  void *kpage;
+
+  if (p == NULL)
+    return false;
+
+  /* Another process running the same program may have the page
+     in memory already. */
+  if (frame_share_text (p))
+    return true;
+
+  kpage = frame_alloc (p, p->type == PAGE_ZERO ? PAL_ZERO : 0);
+  if (kpage == NULL)
+    return false;
+  if (!read_page (p, kpage)
+      || !pagedir_set_page (t->pagedir, p->upage, kpage, p->writable))
+    {
+      frame_free (p, kpage);
+      return false;
+    }
+  frame_unpin (p);
+  return true;
+}
+
+/* Brings the page that contains user virtual address ADDR into
+   memory, if it is not there already, and pins it so that it
+   cannot be evicted until page_unpin().  Returns false if ADDR
+   is not in the current process's supplemental page table or
+   the page cannot be loaded. */
+bool
+page_pin (const void *addr) 
+{
+  struct page *p = page_lookup (pg_round_down (addr));
+
+  if (p == NULL)
+    return false;
+
+  /* The page may be evicted again between loading and pinning
+     it. */
+  while (!frame_pin (p))
+    if (!page_load (addr))
+      return false;
+  return true;
+}
+
+/* Undoes page_pin() for the page that contains user virtual
+   address ADDR. */
+void
+page_unpin (const void *addr) 
+{
+  struct page *p = page_lookup (pg_round_down (addr));
+
+  ASSERT (p != NULL);
+  frame_unpin (p);
+}
+
+/* Handles a write to the page that contains user virtual address
+   ADDR, which the current process has mapped read-only, by
+   giving the process a writable copy of its own if it shares the
+   page with another process after fork(), or by making it
+   writable if it no longer does.  Returns true if successful,
+   false if the page is not writable or no page of memory can be
+   obtained for the copy. */
+bool
+page_unshare (const void *addr) 
+{
+  struct page *p = page_lookup (pg_round_down (addr));
+  return p != NULL && p->writable && frame_unshare (p);
+}
+
+/* Writes the mapped part of PAGE_MMAP page P back to its file,
+   reading it from ADDR, which is either P's kernel address or,
+   if P is mapped and cannot be evicted meanwhile, its user
+   address. */
+void
+page_write_back (struct page *p, const void *addr) 
+{
+  bool held = lock_held_by_current_thread (&file_lock);
+
+  ASSERT (p->type == PAGE_MMAP);
+
+  if (!held)
+    lock_acquire (&file_lock);
+  file_write_at (p->file, addr, p->read_bytes, p->ofs);
+  write_backs++;
+  if (!held)
+    lock_release (&file_lock);
+}
+
+/* Removes user page UPAGE from the current process's
+   supplemental page table, if it is there, and frees its page or
+   swap slot.  A page of a file mapping that the process modified
+   is written back to its file first. */
+void
+page_remove (void *upage) 
+{
+  struct thread *t = thread_current ();
+  struct page *p = page_lookup (upage);
+
+  if (p == NULL)
+    return;
+
+  /* Pinning keeps the page from being evicted, or moved by
+     compaction, while we write it back.  A page that is not in
+     memory has been written back already, if it needed to be,
+     when it was evicted. */
+  if (p->type == PAGE_MMAP && frame_pin (p)
+      && pagedir_is_dirty (t->pagedir, upage))
+    page_write_back (p, upage);
+
+  hash_delete (&t->pages, &p->hash_elem);
+  page_free (&p->hash_elem, NULL);
+}
+
+/* Prints supplemental page table statistics. */
+void
+page_print_stats (void) 
+{
+  printf ("Paging: %lld pages read from files, %lld zero-filled, "
+          "%lld written back to files\n",
+          file_loads, zero_loads, write_backs);
+}
+
+/* Fills KPAGE with the contents of P, which must be zeroed
+   already for PAGE_ZERO.  Returns true if successful, false if
+   the page cannot be read. */
+static bool
+read_page (struct page *p, void *kpage) 
+{
+  switch (p->type) 
+    {
+    case PAGE_FILE:
+    case PAGE_MMAP:
+      {
+        /* We may be handling a fault in a system call that
+           already holds the file system lock. */
+        bool held = lock_held_by_current_thread (&file_lock);
+        off_t read;
+
+        if (!held)
+          lock_acquire (&file_lock);
+        read = file_read_at (p->file, kpage, p->read_bytes, p->ofs);
+        if (!held)
+          lock_release (&file_lock);
+        if (read != (off_t) p->read_bytes)
+          return false;
+        memset ((uint8_t *) kpage + p->read_bytes, 0,
+                PGSIZE - p->read_bytes);
+        file_loads++;
+        return true;
+      }
+
+    case PAGE_ZERO:
+      zero_loads++;
+      return true;
+
+    case PAGE_SWAP:
+      swap_in (p->swap_slot, kpage);
+      p->swap_slot = SWAP_ERROR;
+      return true;
+    }
+  NOT_REACHED ();
+}
+
+/* Returns a new supplemental page table entry for UPAGE of the
+   given TYPE, or a null pointer if memory is not available. */
+static struct page *
+page_create (void *upage, bool writable, enum page_type type) 
+{
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  p = kmem_cache_alloc (page_cache);
+  if (p != NULL)
+    {
+      p->owner = thread_current ();
+      p->upage = upage;
+      p->writable = writable;
+      p->type = type;
+      p->frame = NULL;
+      p->file = NULL;
+      p->ofs = 0;
+      p->read_bytes = 0;
+      p->swap_slot = SWAP_ERROR;
+    }
+  return p;
+}
+
+/* Inserts P into the current process's supplemental page table.
+   Returns true if successful.  If the table already has an entry
+   for P's page, frees P and returns false. */
+static bool
+page_insert (struct page *p) 
+{
+  if (hash_insert (&thread_current ()->pages, &p->hash_elem) != NULL)
+    {
+      kmem_cache_free (page_cache, p);
+      return false;
+    }
+  return true;
+}
+
+/* Returns the current process's supplemental page table entry
+   for UPAGE, or a null pointer if there is none. */
+static struct page *
+page_lookup (const void *upage) 
+{
+  struct page p;
+  struct hash_elem *e;
+
+  p.upage = (void *) upage;
+  e = hash_find (&thread_current ()->pages, &p.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Returns a hash value for the page that E refers to. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  const struct page *p = hash_entry (e, struct page, hash_elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Returns true if the page that A refers to precedes the one
+   that B refers to. */
+static bool
+page_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED) 
+{
+  const struct page *pa = hash_entry (a, struct page, hash_elem);
+  const struct page *pb = hash_entry (b, struct page, hash_elem);
+  return pa->upage < pb->upage;
+}
+
+/* Frees the supplemental page table entry that E refers to,
+   along with its page or swap slot. */
+static void
+page_free (struct hash_elem *e, void *aux UNUSED) 
+{
+  struct page *p = hash_entry (e, struct page, hash_elem);
+
+  /* Releasing the frame waits for any eviction of the page to
+     finish, which may leave it in swap. */
+  frame_release (p);
+  if (p->type == PAGE_SWAP && p->swap_slot != SWAP_ERROR)
+    swap_free (p->swap_slot);
+  kmem_cache_free (page_cache, p);
+}
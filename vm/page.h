@@ -0,0 +1,63 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct frame;
+struct thread;
+
+/* Where the contents of a page come from when it is brought
+   into memory. */
+enum page_type
+  {
+    PAGE_FILE,                  /* Read from a file, zero the rest. */
+    PAGE_ZERO,                  /* All zeros. */
+    PAGE_SWAP,                  /* Swap slot, if not in memory. */
+    PAGE_MMAP                   /* Mapped file, written back if dirty. */
+  };
+
+/* A page of a process's virtual address space, as recorded in
+   its supplemental page table. */
+struct page
+  {
+    struct hash_elem hash_elem; /* Element in struct thread's "pages". */
+    struct thread *owner;       /* Process whose page it is. */
+    void *upage;                /* User virtual address. */
+    bool writable;              /* Writable by the process? */
+    enum page_type type;        /* Source of the page's contents. */
+    struct frame *frame;        /* Frame, if in memory; see frame.c. */
+    struct list_elem frame_elem; /* Element in frame's "pages" list. */
+
+    /* PAGE_FILE and PAGE_MMAP only. */
+    struct file *file;          /* File to read. */
+    off_t ofs;                  /* Offset in FILE. */
+    size_t read_bytes;          /* Bytes to read; the rest are zeroed. */
+
+    /* PAGE_SWAP only. */
+    size_t swap_slot;           /* Slot, or SWAP_ERROR if in memory. */
+  };
+
+void page_init (void);
+bool page_table_init (struct hash *);
+void page_table_destroy (struct hash *);
+bool page_table_copy (struct thread *parent);
+bool page_add_file (void *upage, struct file *, off_t ofs,
+                    size_t read_bytes, bool writable);
+bool page_add_zero (void *upage, bool writable);
+bool page_add_mmap (void *upage, struct file *, off_t ofs,
+                    size_t read_bytes);
+bool page_exists (const void *upage);
+bool page_load (const void *addr);
+bool page_pin (const void *addr);
+void page_unpin (const void *addr);
+bool page_unshare (const void *addr);
+void page_write_back (struct page *, const void *addr);
+void page_remove (void *upage);
+void page_print_stats (void);
+
+#endif /* vm/page.h */
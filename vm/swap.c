@@ -0,0 +1,143 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Swap space.
+
+   The block device in the BLOCK_SWAP role is divided into slots
+   of one page each.  frame.c writes a page that it evicts to a
+   free slot unless the page can be read again from where it came
+   from, and page.c reads it back into memory, freeing the slot,
+   when the process touches it again.  A bitmap records which
+   slots are in use.  Without a swap device, every slot
+   allocation fails.
+
+   A forked process shares its parent's swap slots until one of
+   them reads the page back, so each slot in use also has a count
+   of the pages that refer to it.  The slot is freed when the
+   count drops to zero. */
+
+/* Number of sectors in a swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Swap device, or a null pointer if there is none. */
+static struct block *swap_device;
+
+/* Slots in use and their reference counts.  Protected by
+   swap_lock. */
+static struct bitmap *swap_map;
+static unsigned short *swap_refs;
+static struct lock swap_lock;
+
+/* Statistics. */
+static long long write_cnt;             /* Pages written to swap. */
+static long long read_cnt;              /* Pages read from swap. */
+
+/* Sets up swap space on the swap block device, if there is
+   one. */
+void
+swap_init (void) 
+{
+  lock_init (&swap_lock);
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device == NULL)
+    {
+      printf ("swap: no swap device, pages cannot be swapped out\n");
+      return;
+    }
+
+  swap_map = bitmap_create (block_size (swap_device) / SECTORS_PER_SLOT);
+  if (swap_map == NULL)
+    PANIC ("out of memory creating swap map");
+  swap_refs = calloc (bitmap_size (swap_map), sizeof *swap_refs);
+  if (swap_refs == NULL)
+    PANIC ("out of memory creating swap map");
+}
+
+/* Writes the page at KPAGE to a free swap slot and returns the
+   slot's number.  Returns SWAP_ERROR if swap is full or there is
+   no swap device. */
+size_t
+swap_out (const void *kpage) 
+{
+  size_t slot;
+  size_t i;
+
+  if (swap_map == NULL)
+    return SWAP_ERROR;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (swap_map, 0, 1, false);
+  if (slot != BITMAP_ERROR)
+    {
+      swap_refs[slot] = 1;
+      write_cnt++;
+    }
+  lock_release (&swap_lock);
+  if (slot == BITMAP_ERROR)
+    return SWAP_ERROR;
+
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_write (swap_device, slot * SECTORS_PER_SLOT + i,
+                 (const uint8_t *) kpage + i * BLOCK_SECTOR_SIZE);
+  return slot;
+}
+
+/* Reads the page in swap slot SLOT into KPAGE and drops a
+   reference to the slot, as swap_free() does. */
+void
+swap_in (size_t slot, void *kpage) 
+{
+  size_t i;
+
+  ASSERT (swap_map != NULL);
+
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_read (swap_device, slot * SECTORS_PER_SLOT + i,
+                (uint8_t *) kpage + i * BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&swap_lock);
+  read_cnt++;
+  lock_release (&swap_lock);
+  swap_free (slot);
+}
+
+/* Adds a reference to swap slot SLOT, which is in use, for a
+   page that shares it with another. */
+void
+swap_share (size_t slot) 
+{
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_map, slot));
+  swap_refs[slot]++;
+  lock_release (&swap_lock);
+}
+
+/* Drops a reference to swap slot SLOT without reading it, and
+   frees the slot if that was the last one. */
+void
+swap_free (size_t slot) 
+{
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_map, slot));
+  ASSERT (swap_refs[slot] > 0);
+  if (--swap_refs[slot] == 0)
+    bitmap_reset (swap_map, slot);
+  lock_release (&swap_lock);
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void) 
+{
+  if (swap_map != NULL)
+    printf ("Swap: %zu of %zu slots in use, %lld pages written, "
+            "%lld pages read\n",
+            bitmap_count (swap_map, 0, bitmap_size (swap_map), true),
+            bitmap_size (swap_map), write_cnt, read_cnt);
+}